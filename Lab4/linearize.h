@@ -0,0 +1,82 @@
+// Generated by Tools/gen_linearize.py, do not edit
+// gen_linearize.py --vref 4.096 --target c51 --bits 4
+
+#define LIN_SEGMENT_BITS 4 // ADC codes per segment: 2^LIN_SEGMENT_BITS
+#define LIN_SEGMENTS 64
+#define LIN_SCALE 100 // table entries are hundredths of the unit
+#define LIN_CHANNELS 8
+
+__code const int lin_table[LIN_CHANNELS][LIN_SEGMENTS+1] = {
+    // channel 0: lm335, max error 0.01
+    {
+        -27300, -26659, -26019, -25378, -24737, -24097, -23456, -22816, -22175, -21534, -20894,
+        -20253, -19612, -18972, -18331, -17691, -17050, -16409, -15769, -15128, -14487, -13847,
+        -13206, -12566, -11925, -11284, -10644, -10003,  -9362,  -8722,  -8081,  -7441,  -6800,
+         -6159,  -5519,  -4878,  -4237,  -3597,  -2956,  -2316,  -1675,  -1034,   -394,    247,
+           888,   1528,   2169,   2809,   3450,   4091,   4731,   5372,   6013,   6653,   7294,
+          7934,   8575,   9216,   9856,  10497,  11138,  11778,  12419,  13059,  13700
+    },
+    // channel 1: lm335, max error 0.01
+    {
+        -27300, -26659, -26019, -25378, -24737, -24097, -23456, -22816, -22175, -21534, -20894,
+        -20253, -19612, -18972, -18331, -17691, -17050, -16409, -15769, -15128, -14487, -13847,
+        -13206, -12566, -11925, -11284, -10644, -10003,  -9362,  -8722,  -8081,  -7441,  -6800,
+         -6159,  -5519,  -4878,  -4237,  -3597,  -2956,  -2316,  -1675,  -1034,   -394,    247,
+           888,   1528,   2169,   2809,   3450,   4091,   4731,   5372,   6013,   6653,   7294,
+          7934,   8575,   9216,   9856,  10497,  11138,  11778,  12419,  13059,  13700
+    },
+    // channel 2: lm335, max error 0.01
+    {
+        -27300, -26659, -26019, -25378, -24737, -24097, -23456, -22816, -22175, -21534, -20894,
+        -20253, -19612, -18972, -18331, -17691, -17050, -16409, -15769, -15128, -14487, -13847,
+        -13206, -12566, -11925, -11284, -10644, -10003,  -9362,  -8722,  -8081,  -7441,  -6800,
+         -6159,  -5519,  -4878,  -4237,  -3597,  -2956,  -2316,  -1675,  -1034,   -394,    247,
+           888,   1528,   2169,   2809,   3450,   4091,   4731,   5372,   6013,   6653,   7294,
+          7934,   8575,   9216,   9856,  10497,  11138,  11778,  12419,  13059,  13700
+    },
+    // channel 3: lm335, max error 0.01
+    {
+        -27300, -26659, -26019, -25378, -24737, -24097, -23456, -22816, -22175, -21534, -20894,
+        -20253, -19612, -18972, -18331, -17691, -17050, -16409, -15769, -15128, -14487, -13847,
+        -13206, -12566, -11925, -11284, -10644, -10003,  -9362,  -8722,  -8081,  -7441,  -6800,
+         -6159,  -5519,  -4878,  -4237,  -3597,  -2956,  -2316,  -1675,  -1034,   -394,    247,
+           888,   1528,   2169,   2809,   3450,   4091,   4731,   5372,   6013,   6653,   7294,
+          7934,   8575,   9216,   9856,  10497,  11138,  11778,  12419,  13059,  13700
+    },
+    // channel 4: lm335, max error 0.01
+    {
+        -27300, -26659, -26019, -25378, -24737, -24097, -23456, -22816, -22175, -21534, -20894,
+        -20253, -19612, -18972, -18331, -17691, -17050, -16409, -15769, -15128, -14487, -13847,
+        -13206, -12566, -11925, -11284, -10644, -10003,  -9362,  -8722,  -8081,  -7441,  -6800,
+         -6159,  -5519,  -4878,  -4237,  -3597,  -2956,  -2316,  -1675,  -1034,   -394,    247,
+           888,   1528,   2169,   2809,   3450,   4091,   4731,   5372,   6013,   6653,   7294,
+          7934,   8575,   9216,   9856,  10497,  11138,  11778,  12419,  13059,  13700
+    },
+    // channel 5: lm335, max error 0.01
+    {
+        -27300, -26659, -26019, -25378, -24737, -24097, -23456, -22816, -22175, -21534, -20894,
+        -20253, -19612, -18972, -18331, -17691, -17050, -16409, -15769, -15128, -14487, -13847,
+        -13206, -12566, -11925, -11284, -10644, -10003,  -9362,  -8722,  -8081,  -7441,  -6800,
+         -6159,  -5519,  -4878,  -4237,  -3597,  -2956,  -2316,  -1675,  -1034,   -394,    247,
+           888,   1528,   2169,   2809,   3450,   4091,   4731,   5372,   6013,   6653,   7294,
+          7934,   8575,   9216,   9856,  10497,  11138,  11778,  12419,  13059,  13700
+    },
+    // channel 6: lm335, max error 0.01
+    {
+        -27300, -26659, -26019, -25378, -24737, -24097, -23456, -22816, -22175, -21534, -20894,
+        -20253, -19612, -18972, -18331, -17691, -17050, -16409, -15769, -15128, -14487, -13847,
+        -13206, -12566, -11925, -11284, -10644, -10003,  -9362,  -8722,  -8081,  -7441,  -6800,
+         -6159,  -5519,  -4878,  -4237,  -3597,  -2956,  -2316,  -1675,  -1034,   -394,    247,
+           888,   1528,   2169,   2809,   3450,   4091,   4731,   5372,   6013,   6653,   7294,
+          7934,   8575,   9216,   9856,  10497,  11138,  11778,  12419,  13059,  13700
+    },
+    // channel 7: lm335, max error 0.01
+    {
+        -27300, -26659, -26019, -25378, -24737, -24097, -23456, -22816, -22175, -21534, -20894,
+        -20253, -19612, -18972, -18331, -17691, -17050, -16409, -15769, -15128, -14487, -13847,
+        -13206, -12566, -11925, -11284, -10644, -10003,  -9362,  -8722,  -8081,  -7441,  -6800,
+         -6159,  -5519,  -4878,  -4237,  -3597,  -2956,  -2316,  -1675,  -1034,   -394,    247,
+           888,   1528,   2169,   2809,   3450,   4091,   4731,   5372,   6013,   6653,   7294,
+          7934,   8575,   9216,   9856,  10497,  11138,  11778,  12419,  13059,  13700
+    }
+};
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <at89lp51rd2.h>
 #include <string.h>
+#include "linearize.h" // generated by Tools/gen_linearize.py
 
 /*
 Authors:
@@ -13,6 +14,9 @@ Functionality:
 
 Note:
     This code is build on the adc_spi.c and LCD_4bit code provided on the course page.
+    The ADC codes are converted with the tables in linearize.h, regenerate it when the sensor or
+    VREF changes:
+        python gen_linearize.py --vref 4.096 --target c51 -o ../Lab4/linearize.h
 */
 
 #define CLK 22118400L
@@ -201,11 +205,23 @@ unsigned int volatile GetADC(unsigned char channel)
     return adc;
 }
 
-#define VREF 4.096
+/* ADC code to hundredths of a degree: interpolate between two entries of the channel's table */
+int Linearize(unsigned char channel, unsigned int adc)
+{
+    int y0 = lin_table[channel][adc >> LIN_SEGMENT_BITS];
+    int y1 = lin_table[channel][(adc >> LIN_SEGMENT_BITS) + 1];
+
+    return y0 + (((y1 - y0) * (int)(adc & ((1 << LIN_SEGMENT_BITS) - 1))) >> LIN_SEGMENT_BITS);
+}
+
+//NOTE: THESE BOUNDARY VALUES ARE CHOSEN FOR DEMONSTRATION, NORMAL CONDITIONS CAN BE HIGHER OR LOWER FOR HOT AND COLD STATES
+#define COLD_LIMIT 2200 // 22.00 degrees
+#define HOT_LIMIT 3000  // 30.00 degrees
 
 void main (void)
 {
-    float y;
+    int centideg; // temperature in hundredths of a degree
+    unsigned int magnitude;
     unsigned char i = 0; //The pin we are reading from ADC
     unsigned char c[CHARS_PER_LINE];
     unsigned char temp[CHARS_PER_LINE] = "Temp=";
@@ -218,20 +234,22 @@ void main (void)
 
     while(1)
     {
-        y = (GetADC(i)*VREF) / 1023.0; // Convert the 10-bit integer from the ADC to Voltage
-        y = (100 * y) - 273; // Convert the voltage value to temperature value
-        printf("%5.3f\n", y); //print the temperature value
+        centideg = Linearize(i, GetADC(i)); // Convert the 10-bit integer from the ADC to temperature
+
+        // hundredths to text without float math, the sign is printed on its own since -0.50 has
+        // no sign left after centideg/100
+        magnitude = (centideg < 0) ? -centideg : centideg;
+        sprintf(c,"%s%u.%02u",(centideg < 0) ? "-" : "",magnitude/100,magnitude%100);
+        printf("%s\n", c); //print the temperature value
 
         // rest of this code uses the LCD display to display the temperature value and state
-        sprintf(c,"%f",y); //convert the temperature value to string
         LCDprint(c,2,1); //print temperature value
 
         //depending on temperature value printf the state of room 
-        //NOTE: THESE BOUNDARY VALUES ARE CHOSEN FOR DEMONSTRATION, NORMAL CONDITIONS CAN BE HIGHER OR LOWER FOR HOT AND COLD STATES
-        if(y<22.0){
+        if(centideg<COLD_LIMIT){
             LCDprint("Room State: COLD",1,1);
         }
-        else if(y>30.0){
+        else if(centideg>HOT_LIMIT){
             LCDprint("Room State: HOT",1,1);
         }
         else{
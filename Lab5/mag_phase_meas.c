@@ -7,6 +7,8 @@ Functionality:
 	One signals is used as reference while other signal is tested
 Note:
 	Both signals must have the same frequency to get accurate readings
+	With DOUBLE_BUFFER set, REF and TEST are sampled back to back by the timer 2 interrupt
+	into ping-pong buffers. The main loop processes one buffer while the other one fills.
 */
 
 #include <stdio.h>
@@ -29,6 +31,12 @@ Note:
 #define TEST_SIGNAL P0_1
 #define TEST_CHANNEL 1
 
+#define DOUBLE_BUFFER 1  // 1: timer 2 samples both channels into ping-pong buffers, 0: wait for zero crosses
+#define SAMPLE_RATE 4000L // REF/TEST sample pairs per second
+#define TIMER2_RELOAD (0x10000L-(CLK/SAMPLE_RATE))
+#define BUFFER_SIZE 128  // sample pairs per buffer, 2 buffers x 2 channels x 2 bytes fit in the 1152 bytes of XDATA
+#define LCD_EVERY 8      // the LCD is slow, only update it every few measurements
+
 #define LCD_RS P3_2
 // #define LCD_RW PX_X // Not used in this code, connect the pin to GND
 #define LCD_E  P3_3
@@ -38,6 +46,10 @@ Note:
 #define LCD_D7 P3_7
 #define CHARS_PER_LINE 16
 
+// SPIWrite() and GetADC() are also called by the timer 2 interrupt. They are not reentrant, so
+// their locals must not be overlaid with the locals of functions the main loop may be running.
+#pragma save
+#pragma nooverlay
 unsigned char SPIWrite(unsigned char out_byte)
 {
 	// In the 8051 architecture both ACC and B are bit addressable!
@@ -54,6 +66,7 @@ unsigned char SPIWrite(unsigned char out_byte)
 	
 	return B;
 }
+#pragma restore
 
 unsigned char _c51_external_startup(void)
 {
@@ -178,6 +191,8 @@ void LCDprint(char * string, unsigned char line, bit clear)
 }
 
 /*Read 10 bits from the MCP3008 ADC converter*/
+#pragma save
+#pragma nooverlay
 unsigned int volatile GetADC(unsigned char channel)
 {
 	unsigned int adc;
@@ -195,6 +210,7 @@ unsigned int volatile GetADC(unsigned char channel)
 		
 	return adc;
 }
+#pragma restore
 
 float Measure_Period(void)
 {
@@ -305,6 +321,135 @@ void LCD_UPDATE(float frequency, float Vr_peak, float Vt_peak, float phase)
 
 #define VREF 4.096
 
+#if DOUBLE_BUFFER
+
+#define PI 3.14159265
+
+// ref_buff[i][n] and test_buff[i][n] are sampled at the same timer 2 tick
+__xdata unsigned int ref_buff[2][BUFFER_SIZE];
+__xdata unsigned int test_buff[2][BUFFER_SIZE];
+volatile unsigned char fill_buff = 0;  // buffer the interrupt is filling
+volatile unsigned char fill_index = 0;
+volatile bit buff_ready = 0;           // the other buffer is full and belongs to the main loop until cleared
+volatile unsigned int overruns = 0;    // buffers refilled because the main loop was still busy
+
+float skew; // seconds between the REF and the TEST conversion of one pair
+
+void Timer2_ISR (void) __interrupt (5)
+{
+	TF2 = 0; // Clear timer 2 overflow flag
+
+	ref_buff[fill_buff][fill_index] = GetADC(REF_CHANNEL);
+	test_buff[fill_buff][fill_index] = GetADC(TEST_CHANNEL);
+
+	if(++fill_index == BUFFER_SIZE){
+		fill_index = 0;
+		if(buff_ready){
+			overruns++; // main loop still has the other buffer, fill this one again
+		}
+		else{
+			fill_buff ^= 1;
+			buff_ready = 1;
+		}
+	}
+}
+
+// The TEST conversion starts one GetADC() call after the REF conversion, time it with timer 0
+float Measure_Skew(void)
+{
+	TR0 = 0; // Stop timer 0
+	TMOD &= 0B_1111_0000; // Set timer 0 as 16-bit timer (step 1)
+	TMOD |= 0B_0000_0001; // Set timer 0 as 16-bit timer (step 2)
+	TH0 = 0; TL0 = 0;
+	TR0 = 1;
+	GetADC(REF_CHANNEL);
+	TR0 = 0;
+
+	return (TH0*256.0 + TL0) / CLK;
+}
+
+void Start_Sampling(void)
+{
+	T2CON = 0;    // 16-bit auto reload, counts the CLK
+	RCAP2H = TIMER2_RELOAD/0x100;
+	RCAP2L = TIMER2_RELOAD%0x100;
+	TH2 = RCAP2H;
+	TL2 = RCAP2L;
+	TF2 = 0;
+	ET2 = 1;      // Enable timer 2 interrupt
+	EA = 1;
+	TR2 = 1;      // Start timer 2
+}
+
+/*
+Peak voltages and phase difference from one buffer of time aligned samples
+The magnitude and phase of each channel are one DFT bin at the signal frequency, only whole periods are used
+The phasor is rotated with multiplications so there is no sin/cos call per sample
+*/
+void Process_Buffer(unsigned char b, float period, float * Vr_peak, float * Vt_peak, float * phase)
+{
+	unsigned int n, count;
+	unsigned int r_min = 1023, t_min = 1023;
+	unsigned long r_sum = 0, t_sum = 0;
+	float fs = (float)CLK / (0x10000L - TIMER2_RELOAD); // actual sample rate
+	float w, cw, sw, c, s, tmp;
+	float r_mean, t_mean, x, amp;
+	float r_re = 0.0, r_im = 0.0, t_re = 0.0, t_im = 0.0;
+
+	// number of samples in whole periods, the whole buffer if it is shorter than one period
+	count = (unsigned int)(BUFFER_SIZE / (period * fs)); // periods in the buffer
+	if(count > 0) count = (unsigned int)(count * period * fs + 0.5);
+	if((count == 0) || (count > BUFFER_SIZE)) count = BUFFER_SIZE;
+
+	for(n = 0; n < count; n++){
+		if(ref_buff[b][n] < r_min) r_min = ref_buff[b][n];
+		if(test_buff[b][n] < t_min) t_min = test_buff[b][n];
+		r_sum += ref_buff[b][n];
+		t_sum += test_buff[b][n];
+	}
+	r_mean = (float)r_sum / count;
+	t_mean = (float)t_sum / count;
+
+	w = 2.0 * PI / (period * fs); // radians per sample
+	cw = cosf(w);
+	sw = sinf(w);
+	c = 1.0;
+	s = 0.0;
+	for(n = 0; n < count; n++){
+		x = ref_buff[b][n] - r_mean;
+		r_re += x * c;
+		r_im -= x * s;
+		x = test_buff[b][n] - t_mean;
+		t_re += x * c;
+		t_im -= x * s;
+
+		tmp = c * cw - s * sw; // rotate the phasor by w
+		s = s * cw + c * sw;
+		c = tmp;
+	}
+
+	/*
+	Amplitude of the fundamental is 2*|bin|/count, noise and harmonics outside the bin do not add to it
+	like they add to the largest sample. The ADC can not go below 0V: a signal centred on 0V (as the
+	zero cross inputs need) loses its negative half, and the fundamental of the half that is left is
+	half of the peak. A signal with a DC offset that keeps it above 0V peaks at its mean plus the amplitude.
+	*/
+	amp = 2.0 * sqrtf(r_re * r_re + r_im * r_im) / count;
+	*Vr_peak = ((r_min == 0) ? 2.0 * amp : r_mean + amp) * VREF / 1023.0;
+	amp = 2.0 * sqrtf(t_re * t_re + t_im * t_im) / count;
+	*Vt_peak = ((t_min == 0) ? 2.0 * amp : t_mean + amp) * VREF / 1023.0;
+
+	// TEST is sampled 'skew' seconds after REF, that adds 360*skew/period degrees to it
+	*phase = (atan2f(t_im, t_re) - atan2f(r_im, r_re)) * 180.0 / PI;
+	*phase -= 360.0 * skew / period;
+
+	// phase must be between -180 and 180
+	while(*phase > 180.0) *phase -= 360.0;
+	while(*phase <= -180.0) *phase += 360.0;
+}
+
+#endif
+
 void main (void)
 {
     float period;
@@ -312,11 +457,50 @@ void main (void)
     float Vref_peak;
     float Vtest_peak;
 	float phase_diff = 0.0;
+#if DOUBLE_BUFFER
+	unsigned char lcd_count = 0;
+	unsigned int lost;
+#endif
 
 	waitms(500);
 
 	LCD_4BIT();	
-	
+
+#if DOUBLE_BUFFER
+	skew = Measure_Skew();
+	Start_Sampling();
+
+	while(1)
+	{
+		// The edges are found by polling, an interrupt in between would delay them. Sampling is held
+		// while the period is timed and the buffer being filled starts over, so no buffer has a gap.
+		// The frequency does not change quickly, timing it with every LCD update is enough.
+		if(lcd_count == 0){
+			ET2 = 0;
+			period = Measure_Period(); // get the period of reference signal
+			freq = 1.0 / period;       // calculate frequency
+			fill_index = 0;
+			TF2 = 0;
+			ET2 = 1;
+		}
+
+		while(!buff_ready); // wait for a full buffer
+		Process_Buffer(fill_buff ^ 1, period, &Vref_peak, &Vtest_peak, &phase_diff);
+		buff_ready = 0; // give the buffer back to the interrupt
+
+		// overruns is two bytes the interrupt may change in between, read it until it holds still
+		do { lost = overruns; } while(lost != overruns);
+
+		//print to Putty for testing purposes, a growing Overruns means measurements are skipped
+		printf("freq = %5.3f  Vref_peak = %5.3f  Vtest_peak = %5.3f  Phase = %5.3f  Overruns = %u\n", freq, Vref_peak, Vtest_peak, phase_diff, lost);
+
+		//print values on the LCD Module
+		if(++lcd_count >= LCD_EVERY){
+			lcd_count = 0;
+			LCD_UPDATE(freq,Vref_peak,Vtest_peak,phase_diff);
+		}
+	}
+#else
 	while(1)
 	{
         period = Measure_Period(); // get the period of reference signal
@@ -345,4 +529,5 @@ void main (void)
 		waitms(100); // wait and then repeat 
 
 	}
+#endif
 }
@@ -0,0 +1,82 @@
+// Generated by Tools/gen_linearize.py, do not edit
+// gen_linearize.py --vref 3.3 --target arm --bits 4
+
+#define LIN_SEGMENT_BITS 4 // ADC codes per segment: 2^LIN_SEGMENT_BITS
+#define LIN_SEGMENTS 64
+#define LIN_SCALE 100 // table entries are hundredths of the unit
+#define LIN_CHANNELS 8
+
+const int lin_table[LIN_CHANNELS][LIN_SEGMENTS+1] = {
+    // channel 0: lm335, max error 0.01
+    {
+        -27300, -26784, -26268, -25752, -25235, -24719, -24203, -23687, -23171, -22655, -22139,
+        -21623, -21106, -20590, -20074, -19558, -19042, -18526, -18010, -17494, -16977, -16461,
+        -15945, -15429, -14913, -14397, -13881, -13365, -12848, -12332, -11816, -11300, -10784,
+        -10268,  -9752,  -9235,  -8719,  -8203,  -7687,  -7171,  -6655,  -6139,  -5623,  -5106,
+         -4590,  -4074,  -3558,  -3042,  -2526,  -2010,  -1494,   -977,   -461,     55,    571,
+          1087,   1603,   2119,   2635,   3152,   3668,   4184,   4700,   5216,   5732
+    },
+    // channel 1: lm335, max error 0.01
+    {
+        -27300, -26784, -26268, -25752, -25235, -24719, -24203, -23687, -23171, -22655, -22139,
+        -21623, -21106, -20590, -20074, -19558, -19042, -18526, -18010, -17494, -16977, -16461,
+        -15945, -15429, -14913, -14397, -13881, -13365, -12848, -12332, -11816, -11300, -10784,
+        -10268,  -9752,  -9235,  -8719,  -8203,  -7687,  -7171,  -6655,  -6139,  -5623,  -5106,
+         -4590,  -4074,  -3558,  -3042,  -2526,  -2010,  -1494,   -977,   -461,     55,    571,
+          1087,   1603,   2119,   2635,   3152,   3668,   4184,   4700,   5216,   5732
+    },
+    // channel 2: lm335, max error 0.01
+    {
+        -27300, -26784, -26268, -25752, -25235, -24719, -24203, -23687, -23171, -22655, -22139,
+        -21623, -21106, -20590, -20074, -19558, -19042, -18526, -18010, -17494, -16977, -16461,
+        -15945, -15429, -14913, -14397, -13881, -13365, -12848, -12332, -11816, -11300, -10784,
+        -10268,  -9752,  -9235,  -8719,  -8203,  -7687,  -7171,  -6655,  -6139,  -5623,  -5106,
+         -4590,  -4074,  -3558,  -3042,  -2526,  -2010,  -1494,   -977,   -461,     55,    571,
+          1087,   1603,   2119,   2635,   3152,   3668,   4184,   4700,   5216,   5732
+    },
+    // channel 3: lm335, max error 0.01
+    {
+        -27300, -26784, -26268, -25752, -25235, -24719, -24203, -23687, -23171, -22655, -22139,
+        -21623, -21106, -20590, -20074, -19558, -19042, -18526, -18010, -17494, -16977, -16461,
+        -15945, -15429, -14913, -14397, -13881, -13365, -12848, -12332, -11816, -11300, -10784,
+        -10268,  -9752,  -9235,  -8719,  -8203,  -7687,  -7171,  -6655,  -6139,  -5623,  -5106,
+         -4590,  -4074,  -3558,  -3042,  -2526,  -2010,  -1494,   -977,   -461,     55,    571,
+          1087,   1603,   2119,   2635,   3152,   3668,   4184,   4700,   5216,   5732
+    },
+    // channel 4: lm335, max error 0.01
+    {
+        -27300, -26784, -26268, -25752, -25235, -24719, -24203, -23687, -23171, -22655, -22139,
+        -21623, -21106, -20590, -20074, -19558, -19042, -18526, -18010, -17494, -16977, -16461,
+        -15945, -15429, -14913, -14397, -13881, -13365, -12848, -12332, -11816, -11300, -10784,
+        -10268,  -9752,  -9235,  -8719,  -8203,  -7687,  -7171,  -6655,  -6139,  -5623,  -5106,
+         -4590,  -4074,  -3558,  -3042,  -2526,  -2010,  -1494,   -977,   -461,     55,    571,
+          1087,   1603,   2119,   2635,   3152,   3668,   4184,   4700,   5216,   5732
+    },
+    // channel 5: lm335, max error 0.01
+    {
+        -27300, -26784, -26268, -25752, -25235, -24719, -24203, -23687, -23171, -22655, -22139,
+        -21623, -21106, -20590, -20074, -19558, -19042, -18526, -18010, -17494, -16977, -16461,
+        -15945, -15429, -14913, -14397, -13881, -13365, -12848, -12332, -11816, -11300, -10784,
+        -10268,  -9752,  -9235,  -8719,  -8203,  -7687,  -7171,  -6655,  -6139,  -5623,  -5106,
+         -4590,  -4074,  -3558,  -3042,  -2526,  -2010,  -1494,   -977,   -461,     55,    571,
+          1087,   1603,   2119,   2635,   3152,   3668,   4184,   4700,   5216,   5732
+    },
+    // channel 6: lm335, max error 0.01
+    {
+        -27300, -26784, -26268, -25752, -25235, -24719, -24203, -23687, -23171, -22655, -22139,
+        -21623, -21106, -20590, -20074, -19558, -19042, -18526, -18010, -17494, -16977, -16461,
+        -15945, -15429, -14913, -14397, -13881, -13365, -12848, -12332, -11816, -11300, -10784,
+        -10268,  -9752,  -9235,  -8719,  -8203,  -7687,  -7171,  -6655,  -6139,  -5623,  -5106,
+         -4590,  -4074,  -3558,  -3042,  -2526,  -2010,  -1494,   -977,   -461,     55,    571,
+          1087,   1603,   2119,   2635,   3152,   3668,   4184,   4700,   5216,   5732
+    },
+    // channel 7: lm335, max error 0.01
+    {
+        -27300, -26784, -26268, -25752, -25235, -24719, -24203, -23687, -23171, -22655, -22139,
+        -21623, -21106, -20590, -20074, -19558, -19042, -18526, -18010, -17494, -16977, -16461,
+        -15945, -15429, -14913, -14397, -13881, -13365, -12848, -12332, -11816, -11300, -10784,
+        -10268,  -9752,  -9235,  -8719,  -8203,  -7687,  -7171,  -6655,  -6139,  -5623,  -5106,
+         -4590,  -4074,  -3558,  -3042,  -2526,  -2010,  -1494,   -977,   -461,     55,    571,
+          1087,   1603,   2119,   2635,   3152,   3668,   4184,   4700,   5216,   5732
+    }
+};
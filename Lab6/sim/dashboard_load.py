@@ -0,0 +1,250 @@
+# Authors:
+#   Kerem Oktay
+#   Idil Bil
+#
+# Functionality:
+#   Load test of temp_dashboard.py. Starts the server on ptys that stand in for the boards, fills
+#   the history of every board, then runs for a while with:
+#       watchers  WATCH one board and check that the sequence numbers only go up
+#       pollers   GET one board over and over with the last cursor, one starts with a cursor from
+#                 before a restart of the server
+#       stalled   WATCH and never read. A few GETs bring the send buffer close to the limit, then
+#                 small requests keep the socket readable while new readings push it over, so the
+#                 server drops them while reading a board with their request still pending.
+#                 They reconnect and do it again
+#   The memory and CPU time of the server are sampled from /proc the whole time. It fails if the
+#   server dies, a client sees a sequence number go backwards, a stalled viewer is never dropped
+#   or the memory grows once the history of every board is full.
+#
+#   Examples:
+#       python dashboard_load.py
+#       python dashboard_load.py --boards 8 --rate 2000 --watchers 50 --seconds 60
+#
+# Note:
+#   Linux only, it reads /proc/<pid> of the server.
+
+import argparse
+import os, pty, socket, subprocess, sys, threading, time, tty
+
+here = os.path.dirname(os.path.abspath(__file__))
+server_script = os.path.join(here, '..', 'temp_dashboard.py')
+history_size = 100000 # same as the server
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.errors = []
+        self.watched = 0
+        self.polled = 0
+        self.get_times = []
+        self.drops = 0
+        self.written = 0
+
+    def error(self, text):
+        with self.lock:
+            if len(self.errors) < 20:
+                self.errors.append(text)
+
+def read_status(pid):
+    # resident memory in kB and CPU seconds of the server
+    with open('/proc/%d/status' % pid) as f:
+        rss = int([line for line in f if line.startswith('VmRSS:')][0].split()[1])
+    with open('/proc/%d/stat' % pid) as f:
+        fields = f.read().rsplit(')', 1)[1].split()
+    cpu = (int(fields[11]) + int(fields[12])) / os.sysconf('SC_CLK_TCK')
+    return rss, cpu
+
+def write_board(master, lines, rate, stop, stats):
+    # readings like the board prints them, with a command reply now and then
+    n = 0
+    period = max(0.01, 1.0 / rate) if rate else 0.01 # slow boards get one reading at a time
+    while not stop.is_set():
+        batch = max(1, int(rate * period)) if rate else 1000
+        data = ''.join('%.3f %.3f\n' % (20 + (n + i) % 100 / 10.0, 25.0) for i in range(batch))
+        if n % 5000 < batch:
+            data += '#OK\n'
+        os.write(master, data.encode('ascii'))
+        n += batch
+        with stats.lock:
+            stats.written += batch
+        if lines and n >= lines:
+            return
+        if rate:
+            time.sleep(period)
+
+def connect(path):
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(path)
+    return sock
+
+def watcher(path, board, stop, stats):
+    sock = connect(path)
+    sock.settimeout(1.0)
+    sock.sendall(('WATCH %s -1\n' % board).encode('ascii'))
+    last = -1
+    partial = b''
+    while not stop.is_set():
+        try:
+            data = sock.recv(65536)
+        except socket.timeout:
+            continue
+        if not data:
+            stats.error('watcher of %s disconnected' % board)
+            return
+        lines = (partial + data).split(b'\n')
+        partial = lines.pop()
+        for line in lines:
+            seq = int(line.split()[0])
+            if seq <= last:
+                stats.error('watcher of %s: %d after %d' % (board, seq, last))
+            last = seq
+        with stats.lock:
+            stats.watched += len(lines)
+    sock.close()
+
+def poller(path, board, cursor, stop, stats):
+    sock = connect(path)
+    f = sock.makefile('rb')
+    first = cursor
+    while not stop.is_set():
+        start = time.perf_counter()
+        sock.sendall(('GET %s %d\n' % (board, cursor)).encode('ascii'))
+        count = 0
+        for line in f:
+            fields = line.split()
+            if fields[0] == b'END':
+                end = int(fields[1])
+                break
+            seq = int(fields[0])
+            if seq <= cursor and cursor != first:
+                stats.error('GET %s %d returned %d' % (board, cursor, seq))
+            count += 1
+        else:
+            stats.error('GET %s: connection closed' % board)
+            return
+        if end > history_size * 100:
+            stats.error('GET %s %d echoed END %d' % (board, cursor, end))
+        cursor = end
+        with stats.lock:
+            stats.polled += count
+            stats.get_times.append(time.perf_counter() - start)
+        time.sleep(0.05)
+    sock.close()
+
+def stalled(path, board, stop, stats):
+    while not stop.is_set():
+        sock = connect(path)
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4096)
+        try:
+            sock.sendall(('WATCH %s -1\n' % board).encode('ascii'))
+            sock.sendall(('GET %s -1\n' % board).encode('ascii') * 5)
+            while not stop.is_set():
+                sock.sendall(b'BOARDS\n' * 20)
+                time.sleep(0.001)
+        except OSError:
+            with stats.lock:
+                stats.drops += 1 # the server gave up on us
+        sock.close()
+
+parser = argparse.ArgumentParser(description='Load test of the dashboard server')
+parser.add_argument('--boards', type=int, default=4)
+parser.add_argument('--rate', type=int, default=1000, help='readings per second of every board')
+parser.add_argument('--watchers', type=int, default=20)
+parser.add_argument('--pollers', type=int, default=10)
+parser.add_argument('--stalled', type=int, default=32)
+parser.add_argument('--seconds', type=float, default=20.0)
+args = parser.parse_args()
+
+listen = '/tmp/dashboard_load_%d.sock' % os.getpid()
+masters = []
+command = [sys.executable, server_script, 'serve', '--listen', 'unix:' + listen]
+for i in range(args.boards):
+    master, slave = pty.openpty()
+    tty.setraw(slave) # no echo back to the master before the server opens it
+    masters.append((master, slave))
+    command += ['--board', 'b%d=%s' % (i, os.ttyname(slave))]
+names = ['b%d' % i for i in range(args.boards)]
+
+server = subprocess.Popen(command)
+stats = Stats()
+stop = threading.Event()
+threads = []
+ok = True
+try:
+    while not os.path.exists(listen):
+        time.sleep(0.05)
+    time.sleep(0.5) # boards opened
+
+    # fill the history of every board so the memory has no reason to grow any more
+    fill = [threading.Thread(target=write_board, args=(m, history_size + 1000, 0, stop, stats)) for m, _ in masters]
+    for t in fill:
+        t.start()
+    for t in fill:
+        t.join()
+    time.sleep(1.0)
+    written_before = stats.written
+
+    for i, (master, _) in enumerate(masters):
+        threads.append(threading.Thread(target=write_board, args=(master, 0, args.rate, stop, stats)))
+    for i in range(args.watchers):
+        threads.append(threading.Thread(target=watcher, args=(listen, names[i % args.boards], stop, stats)))
+    for i in range(args.pollers):
+        cursor = 10 ** 9 if i == 0 else -1
+        threads.append(threading.Thread(target=poller, args=(listen, names[i % args.boards], cursor, stop, stats)))
+    for i in range(args.stalled):
+        threads.append(threading.Thread(target=stalled, args=(listen, names[i % args.boards], stop, stats)))
+    for t in threads:
+        t.daemon = True
+        t.start()
+
+    samples = []
+    start = time.time()
+    while time.time() - start < args.seconds and server.poll() is None:
+        samples.append(read_status(server.pid))
+        time.sleep(0.5)
+    elapsed = time.time() - start
+    alive = server.poll() is None
+    stop.set()
+    for t in threads:
+        t.join(2.0)
+
+    print('%d boards at %d readings/s, %d watchers, %d pollers, %d stalled viewers, %.0f s' %
+          (args.boards, args.rate, args.watchers, args.pollers, args.stalled, elapsed))
+    print('  readings written    %8.0f /s' % ((stats.written - written_before) / elapsed))
+    print('  readings watched    %8.0f /s' % (stats.watched / elapsed))
+    print('  readings polled     %8.0f /s' % (stats.polled / elapsed))
+    if stats.get_times:
+        times = sorted(stats.get_times)
+        print('  GET round trip      %8.1f ms median, %.1f ms 99th percentile' %
+              (1000 * times[len(times) // 2], 1000 * times[len(times) * 99 // 100]))
+    print('  stalled viewers dropped %d times' % stats.drops)
+    if samples:
+        settle = samples[len(samples) // 4][0] # a few seconds for the buffers of the clients
+        print('  server memory       %8d kB after the history filled, %d kB at the end, %d kB max' %
+              (settle, samples[-1][0], max(s[0] for s in samples[len(samples) // 4:])))
+        print('  server CPU          %8.0f %%' % (100 * (samples[-1][1] - samples[0][1]) / elapsed))
+
+    checks = [
+        (alive, 'the server is still running'),
+        (not stats.errors, 'clients saw the readings in order'),
+        (stats.watched > 0 and stats.polled > 0, 'readings reached the viewers'),
+        (args.stalled == 0 or stats.drops > 0, 'stalled viewers are dropped'),
+        (not samples or max(s[0] for s in samples[len(samples) // 4:]) - settle < 10000, 'the memory stays flat'),
+    ]
+    for error in stats.errors:
+        print('  ' + error)
+    for passed, what in checks:
+        if not passed:
+            print('  FAIL ' + what)
+            ok = False
+    print('all checks passed' if ok else 'checks failed')
+finally:
+    stop.set()
+    server.terminate()
+    server.wait()
+    for master, slave in masters:
+        os.close(master)
+        os.close(slave)
+    if os.path.exists(listen):
+        os.unlink(listen)
+sys.exit(0 if ok else 1)
@@ -0,0 +1,195 @@
+# Authors:
+#   Kerem Oktay
+#   Idil Bil
+#
+# Functionality:
+#   Test of the PC side of temp_config.py --link: negotiate_link(), fall_back() and the final link
+#   check run against a simulated board on a simulated serial port, on a simulated clock so the
+#   LINK_TIMEOUT_MS fallbacks take no real time. The board answers like the firmware: BAUDS, PROBE
+#   with its CRC, BAUD that goes back after link_timeout without COMMIT. Whatever either side sends
+#   while the two rates differ arrives as garbage. Cases:
+#       all rates work           the link settles at the fastest rate of BAUDS
+#       port stops at 460800     setting 921600 fails on the PC, the board falls back on its own
+#       921600 corrupts bytes    the probe at 921600 fails its CRC, both go back to 460800
+#       BAUD reply lost          the board switched but the PC never saw #OK, it waits for the
+#                                fallback and probes at the old rate
+#       board never comes back   negotiate_link() gives up instead of reporting a link
+#
+#   Examples:
+#       python link_host.py
+#
+# Note:
+#   temp_config.py parses its arguments when it is loaded, only the part above the argument parser
+#   is run here. pyserial is replaced with a stub when it is not installed.
+
+import os, sys, types
+
+here = os.path.dirname(os.path.abspath(__file__))
+config_script = os.path.join(here, '..', 'temp_config.py')
+
+try:
+    import serial
+except ImportError:
+    serial = types.ModuleType('serial')
+    serial.SerialException = type('SerialException', (Exception,), {})
+    serial.tools = types.ModuleType('serial.tools')
+    serial.tools.list_ports = types.ModuleType('serial.tools.list_ports')
+    sys.modules.update({'serial': serial, 'serial.tools': serial.tools,
+                        'serial.tools.list_ports': serial.tools.list_ports})
+
+class Clock:
+    # stands in for the time module of temp_config.py
+    def __init__(self):
+        self.now = 0.0
+
+    def time(self):
+        return self.now
+
+    def sleep(self, seconds):
+        self.now += seconds
+
+clock = Clock()
+source = open(config_script).read()
+config = {'__name__': 'temp_config', '__file__': config_script}
+exec(compile(source[:source.index('parser = argparse')], config_script, 'exec'), config)
+config['time'] = clock
+config['print'] = lambda *args: None # keep the output of the cases short
+
+board_rates = [115200, 230400, 460800, 921600]
+
+class Board:
+    def __init__(self, corrupt=None, lose_reply=None, stuck=False):
+        self.baud = self.prev = 115200
+        self.deadline = None
+        self.line = b''
+        self.out = b''
+        self.corrupt = corrupt       # rate at which every 97th byte sent is wrong
+        self.lose_reply = lose_reply # rate whose BAUD reply never arrives
+        self.stuck = stuck           # never goes back after BAUD
+        self.port = None
+
+    def tick(self):
+        if self.deadline is not None and clock.now >= self.deadline and not self.stuck:
+            self.deadline = None
+            self.baud = self.prev
+            self.line = b''
+
+    def send(self, data):
+        if self.port.baud != self.baud:
+            data = b'?' * len(data)
+        elif self.baud == self.corrupt:
+            data = bytes(c ^ 1 if i % 97 == 5 else c for i, c in enumerate(data))
+        self.out += data
+
+    def receive(self, data):
+        self.tick()
+        if self.port.baud != self.baud:
+            data = bytes(c | 0x80 for c in data)
+        for c in data:
+            if c == ord('\n'):
+                self.command(self.line.decode('latin1').split())
+                self.line = b''
+            else:
+                self.line += bytes([c])
+
+    def command(self, fields):
+        if not fields:
+            return
+        if fields == ['BAUDS']:
+            self.send(b'#BAUDS %s\n#OK\n' % ' '.join(str(r) for r in board_rates).encode('ascii'))
+        elif fields[0] == 'PROBE':
+            lfsr = 0xACE1
+            data = bytearray()
+            for i in range(int(fields[1])):
+                lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xB400)
+                data.append(lfsr & 0xff)
+            self.send(b'#PROBE %d\n' % len(data) + bytes(data) + b'#CRC %04x\n#OK\n' % config['crc16'](data))
+        elif fields[0] == 'BAUD' and int(fields[1]) in board_rates:
+            if int(fields[1]) != self.lose_reply:
+                self.send(b'#OK\n')
+            if self.deadline is None:
+                self.prev = self.baud
+            self.baud = int(fields[1])
+            self.deadline = clock.now + config['link_timeout']
+        elif fields == ['COMMIT'] and self.deadline is not None:
+            self.deadline = None
+            self.send(b'#BAUD %d\n#OK\n' % self.baud)
+        else:
+            self.send(b'#ERR %s\n' % fields[0].encode('latin1'))
+
+class Port:
+    # the parts of serial.Serial temp_config.py uses, reads take the line time of what they return
+    def __init__(self, board, max_baud):
+        self.baud = 115200
+        self.board = board
+        self.max_baud = max_baud
+        board.port = self
+
+    @property
+    def baudrate(self):
+        return self.baud
+
+    @baudrate.setter
+    def baudrate(self, baud):
+        if baud > self.max_baud:
+            raise ValueError('%d baud not supported' % baud)
+        self.baud = baud
+
+    def write(self, data):
+        clock.sleep(len(data) * 10.0 / self.baud)
+        self.board.receive(data)
+
+    def reset_input_buffer(self):
+        self.board.tick()
+        self.board.out = b''
+
+    def take(self, size):
+        self.board.tick()
+        if not self.board.out:
+            clock.sleep(0.1) # read timeout
+            return b''
+        data, self.board.out = self.board.out[:size], self.board.out[size:]
+        clock.sleep(len(data) * 10.0 / self.baud)
+        return data
+
+    def read(self, size):
+        return self.take(size)
+
+    def readline(self):
+        self.board.tick()
+        end = self.board.out.find(b'\n')
+        return self.take(end + 1 if end >= 0 else len(self.board.out))
+
+failures = 0
+
+def check(ok, what):
+    global failures
+    if not ok:
+        print('  FAIL %s' % what)
+        failures += 1
+
+cases = [
+    ('all rates work', Board(), 10**7, True, 921600),
+    ('port stops at 460800', Board(), 460800, True, 460800),
+    ('921600 corrupts bytes', Board(corrupt=921600), 10**7, True, 460800),
+    ('BAUD reply lost', Board(lose_reply=921600), 10**7, True, 460800),
+    ('board never comes back', Board(stuck=True), 460800, False, None),
+]
+
+print('link_host: negotiate_link() of temp_config.py against a simulated board')
+for name, board, max_baud, expect_ok, expect_baud in cases:
+    port = Port(board, max_baud)
+    start = clock.now
+    ok = config['negotiate_link'](port)
+    print('  %-24s %-5s PC %7d, board %7d, %4.1f s' % (name, ok, port.baud, board.baud, clock.now - start))
+    check(ok == expect_ok, '%s: negotiate_link() returned %s' % (name, ok))
+    if expect_ok:
+        check(port.baud == board.baud == expect_baud, '%s: both ends at %d' % (name, expect_baud))
+        check(board.deadline is None, '%s: the board is not waiting for COMMIT' % name)
+        clock.sleep(2 * config['link_timeout'])
+        check(config['probe'](port, config['check_size']) is not None, '%s: the link still works later' % name)
+
+if failures:
+    print('%d checks failed' % failures)
+    sys.exit(1)
+print('all checks passed')
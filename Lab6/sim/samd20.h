@@ -0,0 +1,221 @@
+/* samd20.h: stand-in for the SAMD20 device header when the firmware is compiled on the PC
+ *
+ * Authors:
+ *	Kerem Oktay
+ *	Idil Bil
+ *
+ * Functionality:
+ *	Declares only the registers and bit names temp_sensor_SAMD20E16.c uses, with the same layout
+ *	as the real header. Peripherals that have to react to the firmware (SysTick, RTC, SERCOM1,
+ *	SERCOM3, NVMCTRL) are reached through a function of temp_sensor_sim.c on every access, the way the real
+ *	header reaches them through a fixed address.
+ */
+
+#ifndef SIM_SAMD20_H
+#define SIM_SAMD20_H
+
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 48000000L // set by the makefile of the board
+#endif
+
+typedef struct
+{
+	volatile uint32_t CTRL;
+	volatile uint32_t LOAD;
+	volatile uint32_t VAL;
+	volatile uint32_t CALIB;
+} SysTick_Type;
+
+typedef enum
+{
+	SERCOM1_IRQn = 8,
+	SERCOM3_IRQn = 10
+} IRQn_Type;
+
+// PORT
+extern volatile uint32_t REG_PORT_DIRSET0, REG_PORT_DIRCLR0, REG_PORT_OUTSET0, REG_PORT_OUTCLR0;
+
+#define PORT_PA00 (1u << 0)
+#define PORT_PA01 (1u << 1)
+#define PORT_PA02 (1u << 2)
+#define PORT_PA03 (1u << 3)
+#define PORT_PA04 (1u << 4)
+#define PORT_PA05 (1u << 5)
+#define PORT_PA18 (1u << 18)
+#define PORT_PA24 (1u << 24)
+#define PORT_PA25 (1u << 25)
+
+typedef struct
+{
+	volatile uint32_t DIR, DIRCLR, DIRSET, DIRTGL, OUT, OUTCLR, OUTSET, OUTTGL, IN, CTRL, WRCONFIG;
+	uint8_t reserved[4];
+	struct { volatile uint8_t reg; } PMUX[16];
+	union { struct { volatile uint8_t PMUXEN:1, INEN:1, PULLEN:1, :3, DRVSTR:1, :1; } bit; volatile uint8_t reg; } PINCFG[32];
+} PortGroup;
+
+typedef struct
+{
+	PortGroup Group[2];
+} Port;
+
+// PM and GCLK
+typedef struct
+{
+	volatile uint32_t CTRL, SLEEP, CPUSEL, APBASEL, APBBSEL, APBCSEL;
+	uint8_t reserved[8];
+	struct { volatile uint32_t reg; } AHBMASK, APBAMASK, APBBMASK, APBCMASK;
+} Pm;
+
+#define PM_APBCMASK_SERCOM1 (1u << 3)
+#define PM_APBCMASK_SERCOM3 (1u << 5)
+
+typedef struct
+{
+	struct { volatile uint8_t reg; } CTRL;
+	struct { volatile uint8_t reg; struct { volatile uint8_t :7, SYNCBUSY:1; } bit; } STATUS;
+	struct { volatile uint16_t reg; } CLKCTRL;
+	struct { volatile uint32_t reg; } GENCTRL;
+	struct { volatile uint32_t reg; } GENDIV;
+} Gclk;
+
+#define GCLK_CLKCTRL_ID(value) ((value) & 0x3f)
+#define GCLK_CLKCTRL_GEN(value) (((value) & 0xf) << 8)
+#define GCLK_CLKCTRL_CLKEN (1u << 14)
+#define GCLK_GENDIV_ID(value) ((value) & 0xf)
+#define GCLK_GENDIV_DIV(value) (((value) & 0xffff) << 8)
+#define GCLK_GENCTRL_ID(value) ((value) & 0xf)
+#define GCLK_GENCTRL_SRC_DFLL48M (0x7u << 8)
+#define GCLK_GENCTRL_GENEN (1u << 16)
+#define RTC_GCLK_ID 2
+#define SERCOM1_GCLK_ID_CORE 14
+
+// RTC, only the 32-bit counter mode
+typedef struct
+{
+	struct { volatile uint16_t reg; } CTRL;
+	struct { volatile uint16_t reg; } READREQ;
+	struct { volatile uint16_t reg; } EVCTRL;
+	struct { volatile uint8_t reg; } INTENCLR;
+	struct { volatile uint8_t reg; } INTENSET;
+	struct { volatile uint8_t reg; } INTFLAG;
+	uint8_t reserved1;
+	union { struct { volatile uint8_t :7, SYNCBUSY:1; } bit; volatile uint8_t reg; } STATUS;
+	struct { volatile uint8_t reg; } DBGCTRL;
+	struct { volatile uint8_t reg; } FREQCORR;
+	uint8_t reserved2[3];
+	struct { volatile uint32_t reg; } COUNT;
+	uint8_t reserved3[4];
+	struct { volatile uint32_t reg; } COMP[1];
+} RtcMode0;
+
+typedef union
+{
+	RtcMode0 MODE0;
+} Rtc;
+
+#define RTC_MODE0_CTRL_ENABLE (1u << 1)
+#define RTC_MODE0_CTRL_MODE_COUNT32 (0x0u << 2)
+#define RTC_MODE0_CTRL_PRESCALER_DIV1024 (0xAu << 8)
+#define RTC_READREQ_RCONT (1u << 14)
+#define RTC_READREQ_RREQ (1u << 15)
+
+// SERCOM, USART and SPI views of the same registers
+typedef struct
+{
+	struct { volatile uint32_t reg; } CTRLA;
+	struct { volatile uint32_t reg; } CTRLB;
+	struct { volatile uint8_t reg; } DBGCTRL;
+	uint8_t reserved1;
+	struct { volatile uint16_t reg; } BAUD;
+	struct { volatile uint8_t reg; } INTENCLR;
+	struct { volatile uint8_t reg; } INTENSET;
+	union { struct { volatile uint8_t DRE:1, TXC:1, RXC:1, RXS:1, :4; } bit; volatile uint8_t reg; } INTFLAG;
+	uint8_t reserved2;
+	struct { volatile uint16_t reg; } STATUS;
+	uint8_t reserved3[6];
+	struct { volatile uint16_t reg; } DATA;
+} SercomUsart;
+
+typedef struct
+{
+	struct { volatile uint32_t reg; } CTRLA;
+	struct { volatile uint32_t reg; } CTRLB;
+	struct { volatile uint8_t reg; } DBGCTRL;
+	uint8_t reserved1;
+	struct { volatile uint8_t reg; } BAUD;
+	uint8_t reserved2;
+	struct { volatile uint8_t reg; } INTENCLR;
+	struct { volatile uint8_t reg; } INTENSET;
+	union { struct { volatile uint8_t DRE:1, TXC:1, RXC:1, :5; } bit; volatile uint8_t reg; } INTFLAG;
+	uint8_t reserved3;
+	struct { volatile uint16_t reg; } STATUS;
+	uint8_t reserved4[2];
+	struct { volatile uint32_t reg; } ADDR;
+	struct { volatile uint32_t reg; } DATA;
+} SercomSpi;
+
+typedef union
+{
+	SercomUsart USART;
+	SercomSpi SPI;
+} Sercom;
+
+#define SERCOM_USART_INTENSET_RXC (1u << 2)
+#define SERCOM_USART_STATUS_FERR (1u << 1)
+#define SERCOM_USART_STATUS_BUFOVF (1u << 2)
+
+extern volatile uint32_t REG_SERCOM1_SPI_CTRLB, REG_SERCOM1_SPI_DATA;
+extern volatile uint8_t REG_SERCOM1_SPI_INTFLAG;
+
+// NVMCTRL
+typedef struct
+{
+	struct { volatile uint16_t reg; } CTRLA;
+	uint8_t reserved1[2];
+	union { struct { volatile uint32_t :1, RWS:4, :2, MANW:1, :24; } bit; volatile uint32_t reg; } CTRLB;
+	struct { volatile uint32_t reg; } PARAM;
+	struct { volatile uint8_t reg; } INTENCLR;
+	uint8_t reserved2[3];
+	struct { volatile uint8_t reg; } INTENSET;
+	uint8_t reserved3[3];
+	union { struct { volatile uint8_t READY:1, ERROR:1, :6; } bit; volatile uint8_t reg; } INTFLAG;
+	uint8_t reserved4[3];
+	struct { volatile uint16_t reg; } STATUS;
+	uint8_t reserved5[2];
+	struct { volatile uint32_t reg; } ADDR;
+	struct { volatile uint16_t reg; } LOCK;
+} Nvmctrl;
+
+#define NVMCTRL_CTRLA_CMD_ER (0x02u)
+#define NVMCTRL_CTRLA_CMD_WP (0x04u)
+#define NVMCTRL_CTRLA_CMD_PBC (0x44u)
+#define NVMCTRL_CTRLA_CMDEX_KEY (0xA5u << 8)
+#define NVMCTRL_STATUS_MASK (0x001Eu)
+
+// The peripherals, every access goes through the simulator
+SysTick_Type * sim_systick (void);
+Rtc * sim_rtc (void);
+Sercom * sim_sercom1 (void);
+Sercom * sim_sercom3 (void);
+Nvmctrl * sim_nvmctrl (void);
+volatile uint32_t * sim_spi_ctrla (void);
+
+extern Port sim_port;
+extern Pm sim_pm;
+extern Gclk sim_gclk;
+
+#define SysTick (sim_systick())
+#define RTC (sim_rtc())
+#define SERCOM1 (sim_sercom1())
+#define SERCOM3 (sim_sercom3())
+#define NVMCTRL (sim_nvmctrl())
+#define REG_SERCOM1_SPI_CTRLA (*sim_spi_ctrla())
+#define PORT (&sim_port)
+#define PM (&sim_pm)
+#define GCLK (&sim_gclk)
+
+void NVIC_EnableIRQ (IRQn_Type irq);
+
+#endif
@@ -0,0 +1,1299 @@
+/* temp_sensor_sim.c: runs the Lab 6 firmware on the PC against simulated SAMD20 peripherals
+ *
+ * Authors:
+ *	Kerem Oktay
+ *	Idil Bil
+ *
+ * Functionality:
+ *	temp_sensor_SAMD20E16.c is compiled as it is, with the samd20.h next to this file in place of
+ *	the device header. Most registers are plain memory, the peripherals that have to react are
+ *	simulated on every access:
+ *		SysTick   every COUNTFLAG poll of delayMs() moves the simulated clock by one millisecond
+ *		RTC       COUNT follows the simulated clock, reading it again right away waits for the
+ *		          next count
+ *		SERCOM3   the UART to the PC. Scripted command lines arrive through SERCOM3_Handler() at
+ *		          the baud rate of the PC, everything the board sends (printf and UART3_putc) is
+ *		          captured and takes 10 bits of line time at the baud rate of the board
+ *		SERCOM1   the SPI bus to the MCP3008, every conversion returns the code of a temperature
+ *		          curve picked by the scenario, through the table of the channel in linearize.h
+ *		NVMCTRL   64KB of flash with the page buffer, row erases and the CPU stall of a real
+ *		          write or erase; characters arriving during a stall overflow the USART
+ *	Every boot of the firmware runs in a child process on shared flash, so a reset keeps the flash
+ *	and loses the RAM like on the board.
+ *
+ *	Scenarios:
+ *		commands  parsing of every serial command, settings kept in flash over a reset, a line
+ *		          that lost characters during a flash erase is rejected
+ *		adaptive  replays a 12 hour temperature trace at the fixed rate and with ADAPT 1, prints the
+ *		          conversions and bytes sent per hour of both. SIM_TRACE=file replays a recorded
+ *		          trace instead, one "<seconds> <degrees>" line per reading
+ *		sensor    ADAPT 1 at temperatures across the range of the channel 0 sensor: one ADC step of
+ *		          noise keeps the slow rate, a change of four steps brings back the full rate, also
+ *		          on the second channel of CH 0x03
+ *		link      BAUD without COMMIT falls back in time and the garbage received at the wrong rate
+ *		          does not end up in front of the next command, BAUD with COMMIT stays
+ *		bauds     steps through the rates of BAUDS with PROBE, bytes and readings per second of each
+ *		log       3 hours of the flash log with ADAPT 1 and a reset: timestamps against the real
+ *		          conversions, full pages, erases per row, DUMP, a program grown into the log,
+ *		          RATE 2000 AVG 64 still filling the pages, DEFAULTS writing the page in RAM
+ *		linearize Linearize() against the float curve of the sensor of every channel in linearize.h,
+ *		          and the time per call against the float formula it replaced (host time)
+ *
+ *	Build and run from this directory, a failed check makes it exit with 1:
+ *		cc -O2 -I. -o temp_sensor_sim temp_sensor_sim.c -lm
+ *		./temp_sensor_sim [scenario...]
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <setjmp.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "samd20.h"
+
+#define SIM_FLASH_SIZE 0x10000
+#define SIM_ROW_SIZE 256
+#define SIM_PAGE_SIZE 64
+#define MAX_EVENTS 256
+#define MAX_SAMPLES (1 << 20)
+#define TX_SIZE (16 << 20)
+#define MAX_REPLIES 4096
+#define RX_FIFO 2            // characters the USART keeps while the CPU is stalled by the flash
+#define RX_ALL 0x7fffffff
+#define ROW_ERASE_NS 6000000 // worst case row erase and page write times of the SAMD20 datasheet
+#define PAGE_WRITE_NS 2500000
+#define SPI_BYTE_NS 40000    // 8 bits at 200kHz
+#define RTC_TICK_NS 1024000  // 1MHz generator and the DIV1024 prescaler
+#define DATA_IDLE 0xffff     // DATA holds this when the firmware did not write a character
+
+typedef struct
+{
+	uint64_t at_ns;
+	uint32_t host_baud; // 0: send the text, otherwise the PC switches to this rate
+	char text[64];
+} sim_event_t;
+
+typedef struct
+{
+	uint64_t at_ns;  // time of the conversion
+	uint16_t code;
+	uint8_t channel;
+} sim_sample_t;
+
+// Everything that has to survive a reset of the firmware, in memory shared with the boots
+typedef struct
+{
+	uint64_t now_ns;      // simulated time since the board was powered
+	uint64_t boot_ns;     // start of the current boot
+	uint64_t end_ns;      // the current boot stops at the first delay after this
+	uint32_t board_baud;  // set by UART3_init()
+	uint32_t host_baud;
+	uint64_t baud_ns[8];  // time of every UART3_init() of the boot
+	int num_bauds;
+
+	sim_event_t events[MAX_EVENTS];
+	int num_events;
+	int next_event;       // event being received
+	int next_char;        // character of it
+	uint64_t char_ns;     // time the next character is complete
+	uint32_t rx_lost;     // characters lost while the CPU was stalled
+
+	double (*temperature)(int channel, double seconds);
+	double noise;         // peak ADC noise in LSB
+	uint32_t lfsr;
+	uint32_t conversions;
+	uint32_t num_samples;
+	sim_sample_t samples[MAX_SAMPLES];
+
+	uint8_t flash[SIM_FLASH_SIZE];
+	uint8_t page_saved[SIM_PAGE_SIZE]; // flash contents under the page buffer
+	uint32_t buffer_addr;
+	uint32_t erases[SIM_FLASH_SIZE / SIM_ROW_SIZE];
+	uint32_t page_writes;
+	uint32_t nvm_errors;  // a page written without erasing it first, or without filling the buffer
+	uint64_t stall_ns;
+	uint32_t flash_used;  // end of the program, FLASH_USED of the firmware
+
+	uint32_t tx_len;
+	uint32_t tx_garbage;  // characters sent while the two ends were at different rates
+	uint32_t num_replies;
+	struct
+	{
+		uint32_t at;      // offset in tx
+		uint64_t ns;      // time its first character started
+	} replies[MAX_REPLIES]; // every '#' sent (a reply starts with one), the first MAX_REPLIES of them
+	char tx[TX_SIZE];
+} sim_t;
+
+sim_t * sim;
+jmp_buf sim_stop;
+
+#define FLASH_BASE (sim->flash)
+#define FLASH_USED (sim->flash_used)
+#define main firmware_main
+#include "../temp_sensor_SAMD20E16.c"
+#undef main
+
+// Registers that are plain memory
+volatile uint32_t REG_PORT_DIRSET0, REG_PORT_DIRCLR0, REG_PORT_OUTSET0, REG_PORT_OUTCLR0;
+volatile uint32_t REG_SERCOM1_SPI_CTRLB, REG_SERCOM1_SPI_DATA;
+volatile uint8_t REG_SERCOM1_SPI_INTFLAG;
+Port sim_port;
+Pm sim_pm;
+Gclk sim_gclk;
+
+// State of the simulated peripherals, lost on reset
+SysTick_Type systick;
+int systick_polled;
+Rtc rtc;
+uint64_t rtc_read_ns; // time COUNT was last read
+Sercom sercom1, sercom3;
+int spi_state;   // 0: idle, 1: reply in DATA, 2: reply read
+int spi_index;   // byte of the MCP3008 transfer
+int spi_channel;
+uint16_t spi_code;
+uint32_t spi_ctrla;
+int sercom3_irq;
+int rx_pending, rx_loaded;
+uint16_t rx_char, rx_status;
+int rx_overrun; // characters were lost since the last one delivered
+Nvmctrl nvmctrl;
+
+int failures;
+uint32_t tx_cursor;
+
+void sim_tx (uint8_t c);
+
+void sim_deliver (char c)
+{
+	rx_status = rx_overrun ? SERCOM_USART_STATUS_BUFOVF : 0;
+	if (sim->board_baud != sim->host_baud)
+	{
+		c |= 0x80; // the board sees garbage at the wrong rate
+		rx_status |= SERCOM_USART_STATUS_FERR;
+	}
+	if (!sercom3_irq || !(sercom3.USART.INTENSET.reg & SERCOM_USART_INTENSET_RXC)) return;
+	rx_overrun = 0;
+	rx_char = (uint8_t)c;
+	rx_pending = 1;
+	SERCOM3_Handler();
+	// the interrupt read its character
+	rx_loaded = 0;
+	sercom3.USART.DATA.reg = DATA_IDLE;
+	sercom3.USART.STATUS.reg = 0;
+}
+
+// Scripted lines that are complete by now go to the receive interrupt one character at a time.
+// Only max_rx characters are kept, the USART overwrites the rest while the CPU is stalled.
+void sim_receive (int max_rx)
+{
+	sim_event_t * e;
+	char c;
+
+	while (sim->next_event < sim->num_events)
+	{
+		e = &sim->events[sim->next_event];
+		if (e->at_ns > sim->now_ns) return;
+		if (e->host_baud)
+		{
+			sim->host_baud = e->host_baud;
+			sim->next_event++;
+			continue;
+		}
+		if ((sim->next_char == 0) && (sim->char_ns < e->at_ns)) sim->char_ns = e->at_ns;
+		if (sim->char_ns + 10000000000ull / sim->host_baud > sim->now_ns) return;
+		sim->char_ns += 10000000000ull / sim->host_baud;
+
+		c = e->text[sim->next_char] ? e->text[sim->next_char] : '\n';
+		if (max_rx > 0)
+		{
+			sim_deliver(c);
+			max_rx--;
+		}
+		else
+		{
+			sim->rx_lost++;
+			rx_overrun = 1;
+		}
+		if (c == '\n')
+		{
+			sim->next_event++;
+			sim->next_char = 0;
+		}
+		else
+		{
+			sim->next_char++;
+		}
+	}
+}
+
+void sim_advance (uint64_t ns, int max_rx)
+{
+	sim->now_ns += ns;
+	sim_receive(max_rx);
+}
+
+SysTick_Type * sim_systick (void)
+{
+	if (systick.CTRL & 1)
+	{
+		// the access after a COUNTFLAG poll, one reload period has passed
+		if (systick_polled)
+		{
+			sim_advance((uint64_t)(systick.LOAD + 1) * 1000000000ull / F_CPU, RX_ALL);
+			if (sim->now_ns >= sim->end_ns) longjmp(sim_stop, 1);
+		}
+		systick_polled = 1;
+		systick.CTRL |= 0x10000;
+	}
+	else
+	{
+		systick_polled = 0;
+	}
+	return &systick;
+}
+
+// COUNT runs from the start of the boot. Reading it again with no time passed since the last read
+// is a wait for the next count, the clock moves to it like for a COUNTFLAG poll of SysTick.
+Rtc * sim_rtc (void)
+{
+	if (rtc.MODE0.CTRL.reg & RTC_MODE0_CTRL_ENABLE)
+	{
+		if (sim->now_ns == rtc_read_ns)
+		{
+			sim_advance(RTC_TICK_NS - (sim->now_ns - sim->boot_ns) % RTC_TICK_NS, RX_ALL);
+			if (sim->now_ns >= sim->end_ns) longjmp(sim_stop, 1);
+		}
+		rtc_read_ns = sim->now_ns;
+		rtc.MODE0.COUNT.reg = (sim->now_ns - sim->boot_ns) / RTC_TICK_NS;
+	}
+	return &rtc;
+}
+
+// ADC code of a temperature through the inverse of the channel's table, the simulated sensor is
+// whatever linearize.h was generated for
+double sim_code (int channel, double t)
+{
+	int lo = 0, hi = 1023, mid;
+	int up = Linearize(channel, 1023) > Linearize(channel, 0);
+	double y0, y1;
+
+	t *= LIN_SCALE;
+	if (up ? (t <= Linearize(channel, 0)) : (t >= Linearize(channel, 0))) return 0;
+	if (up ? (t >= Linearize(channel, 1023)) : (t <= Linearize(channel, 1023))) return 1023;
+	while (hi - lo > 1)
+	{
+		mid = (lo + hi) / 2;
+		if ((Linearize(channel, mid) <= t) == up) lo = mid; else hi = mid;
+	}
+	y0 = Linearize(channel, lo);
+	y1 = Linearize(channel, hi);
+	return (y1 == y0) ? lo : lo + (t - y0) / (y1 - y0);
+}
+
+// The MCP3008 answers the start bit with 0, the channel byte with the top 2 bits of the result
+// and the last byte with the low 8 bits
+uint8_t sim_mcp3008 (uint8_t c)
+{
+	double t, code;
+
+	switch (spi_index++ % 3)
+	{
+	case 0:
+		return 0;
+	case 1:
+		spi_channel = (c >> 4) & 7;
+		t = sim->temperature(spi_channel, (double)sim->now_ns / 1e9);
+		sim->lfsr = sim->lfsr * 1103515245 + 12345;
+		code = sim_code(spi_channel, t);
+		code += sim->noise * ((sim->lfsr >> 8) / (double)(1 << 24) * 2 - 1);
+		code = floor(code + 0.5);
+		spi_code = code < 0 ? 0 : (code > 1023 ? 1023 : code);
+		return spi_code >> 8;
+	default:
+		sim->conversions++;
+		if (sim->num_samples < MAX_SAMPLES)
+		{
+			sim->samples[sim->num_samples].at_ns = sim->now_ns;
+			sim->samples[sim->num_samples].code = spi_code;
+			sim->samples[sim->num_samples].channel = spi_channel;
+			sim->num_samples++;
+		}
+		return spi_code & 0xff;
+	}
+}
+
+Sercom * sim_sercom1 (void)
+{
+	if (spi_state == 1)
+	{
+		spi_state = 2; // the reply is being read
+	}
+	else if (spi_state == 2)
+	{
+		sercom1.SPI.DATA.reg = DATA_IDLE;
+		spi_state = 0;
+	}
+	else if (sercom1.SPI.DATA.reg != DATA_IDLE)
+	{
+		// written since the last access, the transfer is done by the RXC poll
+		sim_advance(SPI_BYTE_NS, RX_ALL);
+		sercom1.SPI.DATA.reg = sim_mcp3008(sercom1.SPI.DATA.reg);
+		spi_state = 1;
+	}
+	sercom1.SPI.INTFLAG.bit.DRE = 1;
+	sercom1.SPI.INTFLAG.bit.RXC = 1;
+	return &sercom1;
+}
+
+volatile uint32_t * sim_spi_ctrla (void)
+{
+	spi_ctrla &= ~1u; // the software reset is done right away
+	return &spi_ctrla;
+}
+
+Sercom * sim_sercom3 (void)
+{
+	uint16_t c;
+
+	if (rx_loaded)
+	{
+		return &sercom3; // the interrupt is reading STATUS and DATA of its character
+	}
+	if (sercom3.USART.DATA.reg != DATA_IDLE)
+	{
+		// written by UART3_putc() since the last access
+		c = sercom3.USART.DATA.reg;
+		sercom3.USART.DATA.reg = DATA_IDLE;
+		sim_tx(c);
+	}
+	if (rx_pending)
+	{
+		sercom3.USART.DATA.reg = rx_char;
+		sercom3.USART.STATUS.reg = rx_status;
+		rx_pending = 0;
+		rx_loaded = 1;
+	}
+	else
+	{
+		sercom3.USART.DATA.reg = DATA_IDLE;
+	}
+	sercom3.USART.INTFLAG.bit.DRE = 1;
+	return &sercom3;
+}
+
+void sim_tx (uint8_t c)
+{
+	if (sim->board_baud != sim->host_baud)
+	{
+		c = '?';
+		sim->tx_garbage++;
+	}
+	if ((c == '#') && (sim->num_replies < MAX_REPLIES))
+	{
+		sim->replies[sim->num_replies].at = sim->tx_len;
+		sim->replies[sim->num_replies].ns = sim->now_ns;
+		sim->num_replies++;
+	}
+	if (sim->tx_len < TX_SIZE - 1)
+	{
+		sim->tx[sim->tx_len++] = c;
+		sim->tx[sim->tx_len] = 0;
+	}
+	sim_advance(10000000000ull / sim->board_baud, RX_ALL);
+}
+
+Nvmctrl * sim_nvmctrl (void)
+{
+	uint16_t cmd = nvmctrl.CTRLA.reg;
+	uint32_t addr = nvmctrl.ADDR.reg * 2;
+	int i;
+
+	if ((cmd & 0xff00) == NVMCTRL_CTRLA_CMDEX_KEY)
+	{
+		nvmctrl.CTRLA.reg = 0;
+		switch (cmd & 0x7f)
+		{
+		case NVMCTRL_CTRLA_CMD_ER:
+			addr &= ~(SIM_ROW_SIZE - 1);
+			memset(sim->flash + addr, 0xff, SIM_ROW_SIZE);
+			sim->erases[addr / SIM_ROW_SIZE]++;
+			sim->stall_ns += ROW_ERASE_NS;
+			sim_advance(ROW_ERASE_NS, RX_FIFO);
+			break;
+		case NVMCTRL_CTRLA_CMD_PBC:
+			// the CPU writes into the page buffer, the flash under it is kept aside until WP
+			addr &= ~(SIM_PAGE_SIZE - 1);
+			memcpy(sim->page_saved, sim->flash + addr, SIM_PAGE_SIZE);
+			memset(sim->flash + addr, 0xff, SIM_PAGE_SIZE);
+			sim->buffer_addr = addr;
+			break;
+		case NVMCTRL_CTRLA_CMD_WP:
+			addr &= ~(SIM_PAGE_SIZE - 1);
+			if (addr != sim->buffer_addr) sim->nvm_errors++;
+			for(i = 0; i < SIM_PAGE_SIZE; i++)
+			{
+				// programming only clears bits, setting one needs an erase
+				if (sim->flash[addr + i] & ~sim->page_saved[i]) sim->nvm_errors++;
+				sim->flash[addr + i] &= sim->page_saved[i];
+			}
+			sim->buffer_addr = 0xffffffff;
+			sim->page_writes++;
+			sim->stall_ns += PAGE_WRITE_NS;
+			sim_advance(PAGE_WRITE_NS, RX_FIFO);
+			break;
+		default:
+			sim->nvm_errors++;
+		}
+	}
+	nvmctrl.INTFLAG.bit.READY = 1;
+	return &nvmctrl;
+}
+
+// Functions of the course library the firmware links with
+void init_Clock48 (void)
+{
+}
+
+void UART3_init (uint32_t baud)
+{
+	memset(&sercom3, 0, sizeof(sercom3)); // software reset of SERCOM3
+	sercom3.USART.DATA.reg = DATA_IDLE;
+	rx_pending = rx_loaded = rx_overrun = 0;
+	sim->board_baud = baud;
+	if (sim->num_bauds < 8) sim->baud_ns[sim->num_bauds++] = sim->now_ns;
+}
+
+void NVIC_EnableIRQ (IRQn_Type irq)
+{
+	if (irq == SERCOM3_IRQn) sercom3_irq = 1;
+}
+
+// printf of the firmware goes out through the UART like the retargeted one of the board
+ssize_t sim_uart_write (void * cookie, const char * buf, size_t size)
+{
+	size_t i;
+
+	sim_sercom3(); // a character of UART3_putc() still in DATA goes first
+	for(i = 0; i < size; i++) sim_tx(buf[i]);
+	return size;
+}
+
+// Power up a new board: erased flash, the clock at 0, the PC at 115200 baud
+void sim_reset (double (*temperature)(int channel, double seconds), double noise)
+{
+	memset(sim, 0, sizeof(*sim) - TX_SIZE);
+	sim->tx[0] = 0;
+	memset(sim->flash, 0xff, sizeof(sim->flash));
+	sim->host_baud = 115200;
+	sim->buffer_addr = 0xffffffff;
+	sim->flash_used = 0x8000; // half of the flash, well below the log
+	sim->temperature = temperature;
+	sim->noise = noise;
+	sim->lfsr = 291;
+	tx_cursor = 0;
+}
+
+// Queue a line from the PC, ms after the start of the next boot
+void sim_send (uint32_t ms, const char * text)
+{
+	sim_event_t * e = &sim->events[sim->num_events++];
+
+	e->at_ns = sim->now_ns + (uint64_t)ms * 1000000;
+	e->host_baud = 0;
+	snprintf(e->text, sizeof(e->text), "%s", text);
+}
+
+void sim_host_baud (uint32_t ms, uint32_t baud)
+{
+	sim_event_t * e = &sim->events[sim->num_events++];
+
+	e->at_ns = sim->now_ns + (uint64_t)ms * 1000000;
+	e->host_baud = baud;
+}
+
+// Boot the firmware and run it for ms, the queued lines are sent at their time
+void sim_run (uint32_t ms)
+{
+	cookie_io_functions_t uart = {NULL, sim_uart_write, NULL, NULL};
+	pid_t pid;
+	int status;
+
+	sim->boot_ns = sim->now_ns;
+	sim->end_ns = sim->now_ns + (uint64_t)ms * 1000000;
+	sim->num_bauds = 0;
+	fflush(stdout);
+	pid = fork();
+	if (pid == 0)
+	{
+		memset(&systick, 0, sizeof(systick));
+		memset(&rtc, 0, sizeof(rtc));
+		rtc_read_ns = ~0ull;
+		memset(&sercom1, 0, sizeof(sercom1));
+		memset(&nvmctrl, 0, sizeof(nvmctrl));
+		sercom3_irq = 0;
+		sercom1.SPI.DATA.reg = DATA_IDLE;
+		sercom3.USART.DATA.reg = DATA_IDLE;
+		stdout = fopencookie(NULL, "w", uart);
+		setvbuf(stdout, NULL, _IONBF, 0);
+		if (setjmp(sim_stop) == 0) firmware_main();
+		_exit(0);
+	}
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+	{
+		printf("  FAIL the firmware crashed\n");
+		failures++;
+	}
+	sim->now_ns = sim->end_ns;
+	sim->num_events = sim->next_event = sim->next_char = 0;
+}
+
+void check (int ok, const char * what)
+{
+	if (!ok)
+	{
+		printf("  FAIL %s\n", what);
+		failures++;
+	}
+}
+
+// Copies the next reply block: the '#' lines up to and including "#OK" or "#ERR". Returns 0 if
+// there is none.
+int next_reply (char * reply, int size)
+{
+	const char * line = sim->tx + tx_cursor;
+	const char * end;
+	int len = 0;
+
+	reply[0] = 0;
+	while (*line)
+	{
+		end = strchr(line, '\n');
+		if (end == NULL) break;
+		end++;
+		if ((line[0] == '#') && (len + (end - line) < size))
+		{
+			memcpy(reply + len, line, end - line);
+			len += end - line;
+			reply[len] = 0;
+		}
+		tx_cursor = end - sim->tx;
+		if ((strncmp(line, "#OK", 3) == 0) || (strncmp(line, "#ERR", 4) == 0)) return 1;
+		line = end;
+	}
+	return 0;
+}
+
+double room_22C (int channel, double seconds)
+{
+	return 22.0 + channel;
+}
+
+#define LOST_AT_MS 2000 // the board is waiting for a reading, SAVE runs as soon as it arrives
+
+void test_commands (void)
+{
+	static const struct
+	{
+		const char * command;
+		const char * reply; // a line the reply has to contain
+	} steps[] = {
+		{"COLD abc", "#ERR COLD"},
+		{"COLD 25x", "#ERR COLD"},
+		{"COLD", "#ERR COLD"},
+		{"COLD 35", "#ERR COLD"},            // above HOT
+		{"HOT 21.5", "#ERR HOT"},            // below COLD
+		{"HOT nan", "#ERR HOT"},
+		{"HOT inf", "#ERR HOT"},
+		{"DEADBAND -1", "#ERR DEADBAND"},
+		{"RATE 100ms", "#ERR RATE"},
+		{"AVG 0", "#ERR AVG"},
+		{"MODE F", "#ERR MODE"},
+		{"THIS LINE IS LONGER THAN THE COMMAND BUFFER", "#ERR THIS"},
+		{"cold 18.5", "#COLD 18.50\n"},
+		{"HOT 27.25 ", "#HOT 27.25\n"},
+		{"DEADBAND 0.5", "#DEADBAND 0.50\n"},
+		{"RATE 0250", "#RATE 250\n"},      // decimal, not octal
+		{"RATE 0x-5", "#ERR RATE"},
+		{"CH 0x", "#ERR CH"},
+		{"RATE 0x100", "#RATE 256\n"},
+		{"CH 3", "#CH 0x03\n"},
+		{"SAVE", "#OK"},
+	};
+	int n = sizeof(steps) / sizeof(steps[0]);
+	char reply[1024];
+	char what[128];
+	const char * line;
+	int readings = 0;
+	int i;
+
+	printf("commands: parsing of the serial commands, settings kept in flash\n");
+	sim_reset(room_22C, 0.5);
+	for(i = 0; i < n; i++) sim_send(500 + 400 * i, steps[i].command);
+	sim_run(1000 + 400 * n);
+
+	for(i = 0; i < n; i++)
+	{
+		snprintf(what, sizeof(what), "\"%s\" answered with %s", steps[i].command, steps[i].reply);
+		check(next_reply(reply, sizeof(reply)) && (strstr(reply, steps[i].reply) != NULL), what);
+	}
+	for(line = sim->tx; (line = strchr(line, '\n')) != NULL; line++)
+	{
+		if ((line[1] >= '0') && (line[1] <= '9')) readings++;
+	}
+	check(readings > 10, "readings keep coming between the commands");
+
+	// the saved settings are there after a reset, DEFAULTS brings back the compiled in ones
+	sim_send(500, "SHOW");
+	sim_send(900, "DEFAULTS");
+	sim_run(1500);
+	check(next_reply(reply, sizeof(reply)) && strstr(reply, "#COLD 18.50\n") && strstr(reply, "#HOT 27.25\n") &&
+	      strstr(reply, "#RATE 256\n") && strstr(reply, "#CH 0x03\n"), "settings kept over a reset");
+	check(next_reply(reply, sizeof(reply)) && strstr(reply, "#COLD 22.00\n") && strstr(reply, "#RATE 100\n"),
+	      "DEFAULTS");
+
+	// a line sent during the row erase of SAVE keeps its first two characters and loses the rest
+	// with its end, the next line runs into it: "DE" + "FAULTS" must not be DEFAULTS
+	sim_send(LOST_AT_MS, "SAVE");
+	sim_send(LOST_AT_MS + 2, "DEADBAND 1");
+	sim_send(LOST_AT_MS + 300, "FAULTS");
+	sim_send(LOST_AT_MS + 600, "SHOW");
+	sim_run(LOST_AT_MS + 1000);
+	check(next_reply(reply, sizeof(reply)) && strstr(reply, "#OK"), "SAVE before the lost line");
+	check(sim->rx_lost > 0, "characters lost during the erase");
+	check(next_reply(reply, sizeof(reply)) && strstr(reply, "#ERR"), "line with lost characters answered with #ERR");
+	check(next_reply(reply, sizeof(reply)) && strstr(reply, "#COLD 18.50\n") && strstr(reply, "#DEADBAND 0.50\n"),
+	      "line with lost characters not run");
+	check(sim->nvm_errors == 0, "flash written the way NVMCTRL expects");
+	printf("  %d commands, %u bytes received from the board\n", n + 6, sim->tx_len);
+}
+
+// Synthetic day: steady with one ADC step of noise, the heater steps up, the afternoon sun pushes
+// the room past HOT and it cools down again in the evening
+double room_day (int channel, double seconds)
+{
+	double h = seconds / 3600.0;
+
+	if (h < 3) return 23.0;
+	if (h < 6) return 25.0;
+	if (h < 8) return 25.0 + 3.0 * (h - 6);
+	return 23.0 + 8.0 * exp(-(h - 8) * 1.5);
+}
+
+#define MAX_TRACE 100000
+double trace_time[MAX_TRACE];
+double trace_temp[MAX_TRACE];
+int trace_len;
+
+double room_trace (int channel, double seconds)
+{
+	int lo = 0, hi = trace_len - 1, mid;
+
+	if (seconds <= trace_time[0]) return trace_temp[0];
+	if (seconds >= trace_time[hi]) return trace_temp[hi];
+	while (hi - lo > 1)
+	{
+		mid = (lo + hi) / 2;
+		if (trace_time[mid] <= seconds) lo = mid; else hi = mid;
+	}
+	return trace_temp[lo] + (trace_temp[hi] - trace_temp[lo]) * (seconds - trace_time[lo]) / (trace_time[hi] - trace_time[lo]);
+}
+
+// Time the reply starting here in tx began to go out, 0 if it is not known
+uint64_t reply_ns (const char * line)
+{
+	uint32_t i;
+
+	for(i = 0; i < sim->num_replies; i++)
+	{
+		if (sim->tx + sim->replies[i].at == line) return sim->replies[i].ns;
+	}
+	return 0;
+}
+
+// Number after "name " in the reply, 0 if it is not there
+double reply_value (const char * reply, const char * name)
+{
+	const char * p = strstr(reply, name);
+
+	return p ? atof(p + strlen(name)) : 0;
+}
+
+typedef struct
+{
+	double conversions; // per hour
+	double bytes;       // per hour, readings only
+	double slow;        // part of the time spent at MAXRATE
+	double step_first;  // ms from the step of the trace to the next conversion
+	double step_next;   // ms between the next two conversions
+} replay_t;
+
+replay_t replay (const char * mode, const char * setting, double (*temperature)(int, double), uint32_t ms, uint32_t step_ms)
+{
+	char reply[1024];
+	replay_t r;
+	uint64_t slow_ns = 0, step_ns = (uint64_t)step_ms * 1000000, gap_ns;
+	uint32_t i, prev = 0;
+	int after_step = 0;
+
+	sim_reset(temperature, 0.7);
+	sim_send(200, mode);
+	sim_send(400, "MAXRATE 2000");
+	sim_send(600, setting);
+	sim_send(ms - 1000, "STATS");
+	sim_run(ms);
+	for(i = 0; i < 4; i++) next_reply(reply, sizeof(reply));
+
+	memset(&r, 0, sizeof(r));
+	r.conversions = reply_value(reply, "#CONVERSIONS ") * 3600000.0 / ms;
+	r.bytes = reply_value(reply, "#BYTES ") * 3600000.0 / ms;
+	// gaps of MAXRATE 2000, give or take a count of the RTC, between the conversions of the first
+	// selected channel so a reading of several channels counts once
+	for(i = 1; i < sim->num_samples; i++)
+	{
+		if (sim->samples[i].channel != sim->samples[0].channel) continue;
+		gap_ns = sim->samples[i].at_ns - sim->samples[prev].at_ns;
+		if (gap_ns >= 1990000000ull) slow_ns += gap_ns;
+		if (after_step)
+		{
+			r.step_next = gap_ns / 1e6;
+			after_step = 0;
+		}
+		if (step_ns && (sim->samples[prev].at_ns < step_ns) && (sim->samples[i].at_ns >= step_ns))
+		{
+			r.step_first = (sim->samples[i].at_ns - step_ns) / 1e6;
+			after_step = 1;
+		}
+		prev = i;
+	}
+	r.slow = (double)slow_ns / ((uint64_t)ms * 1000000);
+	return r;
+}
+
+void test_adaptive (void)
+{
+	double (*temperature)(int, double) = room_day;
+	uint32_t ms = 12 * 3600 * 1000, step_ms = 3 * 3600 * 1000;
+	const char * name = getenv("SIM_TRACE");
+	FILE * f;
+	replay_t fixed, adapt, quiet;
+
+	printf("adaptive: conversions and bytes sent on a replayed trace, fixed rate against ADAPT 1\n");
+	if (name != NULL)
+	{
+		f = fopen(name, "r");
+		if (f == NULL)
+		{
+			check(0, "SIM_TRACE can be opened");
+			return;
+		}
+		trace_len = 0;
+		while ((trace_len < MAX_TRACE) && (fscanf(f, "%lf %lf", &trace_time[trace_len], &trace_temp[trace_len]) == 2)) trace_len++;
+		fclose(f);
+		if (trace_len < 2)
+		{
+			check(0, "SIM_TRACE has readings");
+			return;
+		}
+		temperature = room_trace;
+		ms = (trace_time[trace_len - 1] - trace_time[0]) * 1000;
+		step_ms = 0;
+		printf("  %s: %d readings, %.1f hours\n", name, trace_len, ms / 3600000.0);
+	}
+
+	fixed = replay("ADAPT 0", "DEADBAND 0", temperature, ms, step_ms);
+	adapt = replay("ADAPT 1", "DEADBAND 0", temperature, ms, step_ms);
+	quiet = replay("ADAPT 1", "DEADBAND 0.5", temperature, ms, step_ms);
+	printf("                            conversions/h   bytes/h   time at MAXRATE\n");
+	printf("  fixed RATE 100            %13.0f %9.0f %16.0f%%\n", fixed.conversions, fixed.bytes, 100 * fixed.slow);
+	printf("  ADAPT 1                   %13.0f %9.0f %16.0f%%\n", adapt.conversions, adapt.bytes, 100 * adapt.slow);
+	printf("  ADAPT 1, DEADBAND 0.5     %13.0f %9.0f %16.0f%%\n", quiet.conversions, quiet.bytes, 100 * quiet.slow);
+	if (step_ms == 0) return;
+
+	printf("  2 degree step: next conversion after %.0f ms, the one after %.0f ms later\n", adapt.step_first, adapt.step_next);
+	check(adapt.conversions < 0.3 * fixed.conversions, "ADAPT 1 needs less than 30% of the conversions");
+	check(adapt.slow > 0.5, "noise of one ADC step does not keep the rate up");
+	check(quiet.bytes < 0.05 * fixed.bytes, "DEADBAND 0.5 sends less than 5% of the bytes");
+	check((adapt.step_first <= 2500) && (adapt.step_next < 500), "a step brings back the full rate");
+}
+
+// Steady room that steps by a few ADC codes after 45 minutes
+double step_base, step_size;
+
+double room_step (int channel, double seconds)
+{
+	return seconds < 45 * 60 ? step_base : step_base + step_size;
+}
+
+double room_step_ch1 (int channel, double seconds)
+{
+	return channel == 1 ? room_step(channel, seconds) : step_base;
+}
+
+void test_sensor (void)
+{
+	static const double temps[] = {-20, 0, 25, 60, 100};
+	int n = sizeof(temps) / sizeof(temps[0]);
+	uint32_t ms = 3600 * 1000, step_ms = 45 * 60 * 1000;
+	char what[128];
+	replay_t r;
+	int i, code;
+
+	printf("sensor: ADAPT 1 across the range of the channel 0 table, noise against a change of 4 ADC steps\n");
+	printf("   degrees  degrees/step  time at MAXRATE  after the step\n");
+	for(i = 0; i < n; i++)
+	{
+		step_base = temps[i];
+		code = floor(sim_code(0, step_base) + 0.5);
+		if ((code < 4) || (code > 1019)) continue; // outside the range of this sensor
+		step_size = (Linearize(0, code + 4) - Linearize(0, code)) / (double)LIN_SCALE;
+		r = replay("ADAPT 1", "DEADBAND 0", room_step, ms, step_ms);
+		printf("  %8.1f  %12.3f  %14.0f%%  %6.0f ms\n", step_base, fabs(step_size) / 4, 100 * r.slow, r.step_first);
+		snprintf(what, sizeof(what), "noise at %.0f degrees does not keep the rate up", step_base);
+		check(r.slow > 0.5, what);
+		snprintf(what, sizeof(what), "4 ADC steps at %.0f degrees bring back the full rate", step_base);
+		check((r.step_first <= 2500) && (r.step_next < 500), what);
+	}
+
+	// the same step on the second of two channels, the first one stays where it is
+	step_base = 25;
+	code = floor(sim_code(1, step_base) + 0.5);
+	step_size = (Linearize(1, code + 4) - Linearize(1, code)) / (double)LIN_SCALE;
+	r = replay("ADAPT 1", "CH 0x03", room_step_ch1, ms, step_ms);
+	printf("  channel 1 of CH 0x03: %.0f%% at MAXRATE, %.0f ms after the step, then %.0f ms\n", 100 * r.slow, r.step_first, r.step_next);
+	check(r.slow > 0.5, "two steady channels slow down");
+	check((r.step_first <= 2500) && (r.step_next < 500), "4 ADC steps on the second channel bring back the full rate");
+}
+
+void test_link (void)
+{
+	char reply[1024];
+	double fallback_ms;
+
+	printf("link: BAUD without COMMIT goes back to 115200, garbage at the wrong rate is dropped\n");
+	sim_reset(room_22C, 0.5);
+	sim_send(500, "BAUD 921600");   // the PC can not follow and stays at 115200
+	sim_send(1000, "SHOW");         // garbage for the board at 921600
+	sim_send(1500, "SHOW");
+	sim_send(3500, "SHOW");         // after the board went back
+	sim_run(4500);
+	fallback_ms = (sim->num_bauds == 3) ? (sim->baud_ns[2] - sim->baud_ns[1]) / 1e6 : 0;
+	printf("  back at %u baud %.0f ms after the switch, %u characters sent at the wrong rate\n",
+	       sim->board_baud, fallback_ms, sim->tx_garbage);
+	check(next_reply(reply, sizeof(reply)) && strstr(reply, "#OK"), "BAUD 921600 accepted");
+	check((sim->board_baud == 115200) && (fallback_ms > LINK_TIMEOUT_MS - 2) && (fallback_ms < LINK_TIMEOUT_MS + 150),
+	      "the board goes back after LINK_TIMEOUT_MS of real time");
+	check(next_reply(reply, sizeof(reply)) && strstr(reply, "#RATE 100\n") && strstr(reply, "#OK"),
+	      "the first command after going back is not mixed with the garbage");
+
+	// with COMMIT the new rate stays
+	sim_reset(room_22C, 0.5);
+	sim_send(500, "BAUD 921600");
+	sim_host_baud(700, 921600);
+	sim_send(800, "COMMIT");
+	sim_send(4000, "SHOW");
+	sim_run(4500);
+	check(next_reply(reply, sizeof(reply)) && next_reply(reply, sizeof(reply)) && strstr(reply, "#BAUD 921600"), "COMMIT");
+	check(next_reply(reply, sizeof(reply)) && strstr(reply, "#OK") && (sim->board_baud == 921600),
+	      "the committed rate stays");
+}
+
+#define PROBE_BYTES 8192 // same as the probe of temp_config.py --link
+#define LINE_BYTES 8     // "23.456 \n", a reading of one channel
+
+// Every rate of BAUDS with the PC following: BAUD, COMMIT and a PROBE, timed from the "#PROBE"
+// line to the "#CRC" line. Only the line time of the characters is simulated, not the CPU time
+// printf and UART3_putc() take between them.
+void test_bauds (void)
+{
+	char reply[1024], command[32];
+	const char * probe, * data, * p;
+	uint32_t rates[8], baud;
+	uint16_t crc;
+	double seconds, speed;
+	int num = 0, i, n, good;
+
+	printf("bauds: PROBE %d at every rate of BAUDS, the PC follows every switch\n", PROBE_BYTES);
+	sim_reset(room_22C, 0.5);
+	sim_send(500, "BAUDS");
+	sim_run(1000);
+	if (next_reply(reply, sizeof(reply)) && ((p = strstr(reply, "#BAUDS")) != NULL))
+	{
+		for(p += 6; (num < 8) && (sscanf(p, " %u%n", &rates[num], &n) == 1); p += n) num++;
+	}
+	check(num > 1, "BAUDS lists more than one rate");
+
+	printf("     baud     bytes/s  readings/s of one channel\n");
+	for(i = 0; i < num; i++)
+	{
+		baud = rates[i];
+		sim_reset(room_22C, 0.5);
+		snprintf(command, sizeof(command), "BAUD %u", baud);
+		sim_send(500, command);
+		sim_host_baud(700, baud);
+		sim_send(800, "COMMIT");
+		snprintf(command, sizeof(command), "PROBE %d", PROBE_BYTES);
+		sim_send(1000, command);
+		sim_run(1500 + (uint32_t)(PROBE_BYTES * 10000.0 / baud));
+
+		// "#PROBE n\n", n bytes and right after them "#CRC xxxx\n", checked like the PC does
+		probe = memmem(sim->tx, sim->tx_len, "#PROBE ", 7);
+		data = probe ? strchr(probe, '\n') + 1 : NULL;
+		speed = 0;
+		crc = 0xFFFF;
+		good = 0;
+		if ((data != NULL) && (data + PROBE_BYTES + 10 <= sim->tx + sim->tx_len) && (strncmp(data + PROBE_BYTES, "#CRC ", 5) == 0))
+		{
+			for(n = 0; n < PROBE_BYTES; n++) crc = CRC16(crc, data[n]);
+			good = (crc == strtoul(data + PROBE_BYTES + 5, NULL, 16));
+			seconds = (reply_ns(data + PROBE_BYTES) - reply_ns(probe)) / 1e9;
+			if (reply_ns(probe) && (seconds > 0)) speed = (data + PROBE_BYTES - probe) / seconds;
+		}
+		printf("  %7u  %10.0f  %10.0f\n", baud, speed, speed / LINE_BYTES);
+		snprintf(reply, sizeof(reply), "PROBE at %u baud arrives with its CRC, close to the line rate", baud);
+		check((sim->board_baud == baud) && good && (speed > 0.95 * baud / 10), reply);
+	}
+	printf("  line time only, the CPU time between the characters is not simulated\n");
+}
+
+// A room that warms up and cools down by a degree every 10 minutes, ADAPT 1 keeps changing the
+// time between samples
+double room_wave (int channel, double seconds)
+{
+	return 23.0 + sin(seconds * 2 * M_PI / 600);
+}
+
+typedef struct
+{
+	uint32_t seq;
+	uint32_t time_ms;
+	uint16_t adc;
+	uint8_t channel;
+	uint8_t full; // the page has LOG_SAMPLES samples
+} log_entry_t;
+
+#define LOG_PAGES ((LOG_END - LOG_START) / NVM_PAGE_SIZE)
+log_entry_t entries[LOG_PAGES * LOG_SAMPLES];
+const uint8_t * log_pages[LOG_PAGES]; // oldest first
+int num_log_pages;
+
+int by_seq (const void * a, const void * b)
+{
+	uint32_t x = ((const log_page_t *)*(const uint8_t **)a)->seq;
+	uint32_t y = ((const log_page_t *)*(const uint8_t **)b)->seq;
+
+	return x < y ? -1 : (x > y);
+}
+
+// Samples of the flash log oldest first, decoded the way temp_config.py does
+int read_log (void)
+{
+	const log_page_t * p;
+	uint32_t addr, time_ms, entry, delta;
+	int num = 0;
+	int i, n;
+
+	num_log_pages = 0;
+	for(addr = LOG_START; addr < LOG_END; addr += NVM_PAGE_SIZE)
+	{
+		if (((const log_page_t *)(sim->flash + addr))->seq != 0xffffffff) log_pages[num_log_pages++] = sim->flash + addr;
+	}
+	qsort(log_pages, num_log_pages, sizeof(log_pages[0]), by_seq);
+	for(i = 0; i < num_log_pages; i++)
+	{
+		p = (const log_page_t *)log_pages[i];
+		time_ms = p->time_ms;
+		for(n = 0; n < p->count; n++)
+		{
+			entry = p->data[3*n] | (p->data[3*n+1] << 8) | (p->data[3*n+2] << 16);
+			delta = entry >> 10;
+			if (n > 0) time_ms += ((delta & LOG_DELTA_MAX) << (LOG_SCALE_SHIFT * (delta >> LOG_DELTA_BITS))) * LOG_TICK_MS;
+			entries[num].seq = p->seq;
+			entries[num].time_ms = time_ms;
+			entries[num].adc = entry & 0x3ff;
+			entries[num].channel = p->channel;
+			entries[num].full = (p->count == LOG_SAMPLES);
+			num++;
+		}
+	}
+	return num;
+}
+
+// Compares the log samples from..to-1 with the conversions of one boot, one to one from the
+// conversion closest in time to the first of them. Returns the largest time error in ms, -1 if
+// a code differs.
+double match_log (int from, int to, uint32_t first_sample, uint64_t boot_ns, double offset_ms)
+{
+	uint32_t i, s = first_sample;
+	double t, err, max_err = 0;
+
+	for(i = first_sample; i < sim->num_samples; i++)
+	{
+		t = (sim->samples[i].at_ns - boot_ns) / 1e6 + offset_ms;
+		if (fabs(t - entries[from].time_ms) < fabs((sim->samples[s].at_ns - boot_ns) / 1e6 + offset_ms - entries[from].time_ms)) s = i;
+	}
+	for(i = from; i < to; i++, s++)
+	{
+		if ((s >= sim->num_samples) || (sim->samples[s].code != entries[i].adc)) return -1;
+		err = fabs((sim->samples[s].at_ns - boot_ns) / 1e6 + offset_ms - entries[i].time_ms);
+		if (err > max_err) max_err = err;
+	}
+	return max_err;
+}
+
+#define LONG_GAP_MS (150 * 60 * 1000) // three full pages of samples 128 s apart and a part of one
+
+void test_log (void)
+{
+	char reply[1024];
+	const char * dump;
+	uint32_t boot1_seq, boot2_sample, min_erases = 0xffffffff, max_erases = 0, changes = 0;
+	uint64_t boot2_ns;
+	double err1, err2;
+	int num, boot1, i, n, full = 1, ordered = 1, same = 1;
+
+	printf("log: flash log with ADAPT 1 over a reset\n");
+	sim_reset(room_wave, 0.7);
+	sim_send(200, "LOG 1");
+	sim_send(400, "ADAPT 1");
+	sim_send(600, "SAVE");
+	sim_run(3 * 3600 * 1000);
+	num = read_log();
+	boot1 = num;
+	boot1_seq = entries[num - 1].seq + 1;
+	for(i = 2; i < num; i++)
+	{
+		if (entries[i].time_ms - entries[i - 1].time_ms != entries[i - 1].time_ms - entries[i - 2].time_ms) changes++;
+	}
+	err1 = match_log(0, num, 0, 0, 0);
+
+	// the log goes on after a reset, the page in RAM is lost
+	boot2_ns = sim->now_ns;
+	boot2_sample = sim->num_samples;
+	for(i = 0; i < 10; i++) sim_send(30000 * (i + 1), "STATS");
+	sim_send(599000, "DUMP");
+	sim_run(600 * 1000);
+	num = read_log();
+	for(boot1 = 0; (boot1 < num) && (entries[boot1].seq < boot1_seq); boot1++) {}
+	err2 = match_log(boot1, num, boot2_sample, boot2_ns, entries[boot1].time_ms - (sim->samples[boot2_sample].at_ns - boot2_ns) / 1e6);
+	for(i = 1; i < num; i++)
+	{
+		if (entries[i].time_ms < entries[i - 1].time_ms) ordered = 0;
+		if (!entries[i - 1].full && (entries[i].seq != entries[i - 1].seq)) full = 0; // only the newest page can be short
+	}
+	for(i = LOG_START / SIM_ROW_SIZE; i < LOG_END / SIM_ROW_SIZE; i++)
+	{
+		if (sim->erases[i] < min_erases) min_erases = sim->erases[i];
+		if (sim->erases[i] > max_erases) max_erases = sim->erases[i];
+	}
+
+	// DUMP sends the pages of the flash, oldest first
+	dump = memmem(sim->tx, sim->tx_len, "#DUMP ", 6);
+	n = dump ? atoi(dump + 6) : 0;
+	same = (dump != NULL) && (n == num_log_pages);
+	if (same) dump = strchr(dump, '\n') + 1;
+	for(i = 0; (i < n) && same; i++)
+	{
+		same = (dump + (i + 1) * NVM_PAGE_SIZE <= sim->tx + sim->tx_len) && (memcmp(dump + i * NVM_PAGE_SIZE, log_pages[i], NVM_PAGE_SIZE) == 0);
+	}
+
+	printf("  %d samples in %d pages, the time between samples changed %u times\n", num, num_log_pages, changes);
+	printf("  %u page writes, %u to %u erases per row, timestamps within %.1f ms before and %.1f ms after the reset\n",
+	       sim->page_writes, min_erases, max_erases, err1, err2);
+	printf("  %u characters lost while the CPU was stalled by the flash\n", sim->rx_lost);
+	check((err1 >= 0) && (err1 <= LOG_TICK_MS + 2), "timestamps of the log match the conversions");
+	check((err2 >= 0) && (err2 <= LOG_TICK_MS + 2), "timestamps go on after a reset");
+	check(ordered, "log times never go back");
+	check(full, "pages are only written when they are full");
+	check(max_erases - min_erases <= 1, "erases spread evenly over the rows");
+	check(sim->nvm_errors == 0, "flash written the way NVMCTRL expects");
+	check(same, "DUMP sends every page oldest first");
+
+	// RATE 2000 with AVG 64 logs every 128 s, longer than the 4ms unit counts: the pages still fill
+	// up, the times are within the 64ms unit and DEFAULTS writes the page that was in RAM
+	sim_reset(room_22C, 0.5);
+	sim_send(200, "LOG 1");
+	sim_send(400, "RATE 2000");
+	sim_send(600, "AVG 64");
+	sim_send(LONG_GAP_MS - 1000, "DEFAULTS");
+	sim_run(LONG_GAP_MS);
+	num = read_log();
+	full = 1;
+	err1 = 0;
+	for(i = 0; i < num; i++)
+	{
+		if (!entries[i].full && (i + 1 < num) && (entries[i + 1].seq != entries[i].seq)) full = 0;
+		err2 = 1e9;
+		for(n = 0; n < (int)sim->num_samples; n++)
+		{
+			if (fabs(sim->samples[n].at_ns / 1e6 - entries[i].time_ms) < err2) err2 = fabs(sim->samples[n].at_ns / 1e6 - entries[i].time_ms);
+		}
+		if (err2 > err1) err1 = err2;
+	}
+	printf("  RATE 2000 AVG 64: %d samples in %d pages, timestamps within %.1f ms\n", num, num_log_pages, err1);
+	check(full && (num_log_pages < num / 8), "pages fill up with 128 s between samples");
+	check(err1 <= 64 + 2, "long gaps are timed to the coarser unit");
+	check((num > 0) && (entries[num - 1].time_ms > LONG_GAP_MS - 1000 - 128000 - 2000), "DEFAULTS writes the page in RAM");
+
+	// a program that grew into the log rows must not lose them to ERASELOG
+	sim_reset(room_22C, 0.5);
+	sim->flash_used = LOG_START + 0x100;
+	sim_send(200, "LOG 1");
+	sim_send(400, "ERASELOG");
+	sim_send(600, "DUMP");
+	sim_run(1000);
+	check(next_reply(reply, sizeof(reply)) && strstr(reply, "#ERR LOG"), "LOG 1 refused when the program reaches the log");
+	check(next_reply(reply, sizeof(reply)) && strstr(reply, "#ERR ERASELOG"), "ERASELOG refused");
+	check(next_reply(reply, sizeof(reply)) && strstr(reply, "#ERR DUMP"), "DUMP refused");
+	for(n = 0, i = 0; i < SIM_FLASH_SIZE / SIM_ROW_SIZE; i++) n += sim->erases[i];
+	check(n == 0, "no row erased");
+}
+
+// Sensor curve of a channel the way gen_linearize.py evaluates it, from the "// channel N: SENSOR"
+// comment it wrote into linearize.h
+double sensor_curve (const char * spec, double code)
+{
+	double v = code * VREF / 1023.0, x, r, t, y;
+	double r0, beta, rfixed;
+	char * end;
+
+	if (strcmp(spec, "lm335") == 0) return 100.0 * v - 273.0;
+	if (strcmp(spec, "volts") == 0) return v;
+	if (sscanf(spec, "ntc:%lf:%lf:%lf", &r0, &beta, &rfixed) == 3)
+	{
+		x = fmin(fmax(code, 0.5), 1022.5) / 1023.0;
+		r = rfixed * x / (1.0 - x);
+		t = 1.0 / (1.0 / 298.15 + log(r / r0) / beta) - 273.15;
+		return fmin(fmax(t, -55.0), 150.0);
+	}
+	if (strncmp(spec, "poly:", 5) == 0)
+	{
+		y = 0;
+		x = 1;
+		for(spec += 5; *spec; spec = end + (*end == ','))
+		{
+			y += strtod(spec, &end) * x;
+			x *= v;
+			if (end == spec) return NAN;
+		}
+		return y;
+	}
+	return NAN;
+}
+
+double ns_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#define BENCH_ROUNDS 20000 // times every code is converted for the host time per call
+
+void test_linearize (void)
+{
+	char line[256], * end;
+	double header_error[LIN_CHANNELS], err, max_err, start, table_ns, float_ns;
+	char specs[LIN_CHANNELS][64];
+	volatile int isink = 0;
+	volatile float fsink = 0;
+	FILE * f;
+	int channel, code, i, skip;
+
+	printf("linearize: Linearize() against the float curve of every channel, host time per call\n");
+	memset(specs, 0, sizeof(specs));
+	f = fopen("../linearize.h", "r");
+	if (f == NULL)
+	{
+		check(0, "../linearize.h can be opened");
+		return;
+	}
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		// the sensor can have commas itself (poly:c0,c1,...), it ends at the last ", max error"
+		end = strstr(line, ", max error ");
+		skip = 0;
+		if ((end != NULL) && (sscanf(line, " // channel %d: %n", &channel, &skip) == 1) && (skip > 0) &&
+		    (channel >= 0) && (channel < LIN_CHANNELS))
+		{
+			*end = 0;
+			snprintf(specs[channel], sizeof(specs[channel]), "%s", line + skip);
+			header_error[channel] = atof(end + strlen(", max error "));
+		}
+	}
+	fclose(f);
+
+	printf("  channel  sensor                   max error  in the header\n");
+	for(channel = 0; channel < LIN_CHANNELS; channel++)
+	{
+		if (specs[channel][0] == 0) continue;
+		max_err = 0;
+		for(code = 0; code < 1024; code++)
+		{
+			err = fabs(Linearize(channel, code) / (double)LIN_SCALE - sensor_curve(specs[channel], code));
+			if (!(err <= max_err)) max_err = err; // NaN of an unknown sensor fails the check
+		}
+		printf("  %7d  %-24s %9.4f  %13.2f\n", channel, specs[channel], max_err, header_error[channel]);
+		snprintf(line, sizeof(line), "channel %d within the error gen_linearize.py reported", channel);
+		check(max_err <= header_error[channel] + 1.0 / LIN_SCALE, line); // the header rounds it, against the curve rounded to hundredths
+	}
+
+	// the firmware before the tables: 100*V - 273 in float for every reading
+	start = ns_now();
+	for(i = 0; i < BENCH_ROUNDS; i++)
+	{
+		for(code = 0; code < 1024; code++) isink += Linearize(0, code);
+	}
+	table_ns = (ns_now() - start) / (BENCH_ROUNDS * 1024.0);
+	start = ns_now();
+	for(i = 0; i < BENCH_ROUNDS; i++)
+	{
+		for(code = 0; code < 1024; code++) fsink += 100 * ((code * (float)VREF) / 1023.0f) - 273;
+	}
+	float_ns = (ns_now() - start) / (BENCH_ROUNDS * 1024.0);
+	printf("  Linearize()            %6.2f ns per call\n", table_ns);
+	printf("  100*V - 273 in float   %6.2f ns per call (what it replaced)\n", float_ns);
+	printf("  host times with an FPU, on the Cortex-M0+ and the 8051 float is done in software; cycles on\n");
+	printf("  those were not measured\n");
+}
+
+int main (int argc, char ** argv)
+{
+	static const struct
+	{
+		const char * name;
+		void (*run)(void);
+	} scenarios[] = {
+		{"commands", test_commands},
+		{"adaptive", test_adaptive},
+		{"sensor", test_sensor},
+		{"link", test_link},
+		{"bauds", test_bauds},
+		{"log", test_log},
+		{"linearize", test_linearize},
+	};
+	int num = sizeof(scenarios) / sizeof(scenarios[0]);
+	int i, j;
+
+	sim = mmap(NULL, sizeof(sim_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (sim == MAP_FAILED)
+	{
+		perror("mmap");
+		return 1;
+	}
+
+	for(i = 0; i < num; i++)
+	{
+		for(j = 1; (j < argc) && (strcmp(argv[j], scenarios[i].name) != 0); j++) {}
+		if ((argc == 1) || (j < argc)) scenarios[i].run();
+	}
+	printf(failures ? "%d checks failed\n" : "all checks passed\n", failures);
+	return failures ? 1 : 0;
+}
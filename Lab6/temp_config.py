@@ -0,0 +1,245 @@
+# Authors:
+#   Kerem Oktay
+#   Idil Bil
+#
+# Functionality:
+#   Changes the settings of the temperature logger over serial comm without reflashing.
+#   Each argument is sent as one command and the reply of the board is printed.
+#
+#   Examples:
+#       python temp_config.py SHOW
+#       python temp_config.py --port COM8 "RATE 250" "AVG 4" "COLD 20" "HOT 28" SAVE
+#       python temp_config.py "CH 0x03" "MODE RAW"
+#       python temp_config.py --dump log.csv
+#       python temp_config.py --link
+#
+#   --dump reads the flash log of the board and saves it as time, channel, ADC value, temperature.
+#   --link steps the board and the PC up through the baud rates the board supports. Each rate is
+#   checked with a CRC'd probe burst and the fastest one that works is kept until the board resets.
+#   Open the stripchart with the --baud it prints.
+#
+# Note:
+#   The stripchart must be closed while this runs, only one program can open the port.
+
+import argparse
+import serial
+import serial.tools.list_ports
+import os, re, struct
+import sys, time
+
+reply_timeout = 2.0 # seconds to wait for the board to answer a command
+table_file = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'linearize.h') # same tables as the firmware
+page_size = 64      # flash page of the SAMD20
+page_header = '<IIBB' # seq, time_ms, count, channel (log_page_t in the firmware)
+log_samples = 18    # LOG_SAMPLES, 3 bytes each
+log_tick_ms = 4     # LOG_TICK_MS, unit of the time between two samples
+log_delta_bits = 12 # LOG_DELTA_BITS, the count of units, the scale of the unit is above it
+log_scale_shift = 4 # LOG_SCALE_SHIFT, every scale is 16 times the one below
+probe_size = 8192   # bytes the board sends to test a baud rate
+check_size = 256    # bytes of the short probe that checks the link still works
+link_timeout = 2.0  # LINK_TIMEOUT_MS in the firmware, the board goes back to the old rate after this
+bytes_per_sample = 8 # "23.456 \n"
+
+def send_command(ser, command):
+    ser.write((command + '\n').encode('ascii'))
+    deadline = time.time() + reply_timeout
+    while time.time() < deadline:
+        line = ser.readline().decode('ascii', errors='replace').strip()
+        if not line.startswith('#'):
+            continue  # temperature readings are still flowing, skip them
+        print(line[1:])
+        if line.startswith('#OK'):
+            return True
+        if line.startswith('#ERR'):
+            return False
+    print('No reply to "%s"' % command)
+    return False
+
+def read_reply_line(ser, prefix):
+    deadline = time.time() + reply_timeout
+    while time.time() < deadline:
+        line = ser.readline().decode('ascii', errors='replace').strip()
+        if line.startswith(prefix):
+            return line
+    return None
+
+def read_exact(ser, size):
+    data = b''
+    while len(data) < size:
+        chunk = ser.read(size - len(data))
+        if not chunk:
+            break
+        data += chunk
+    return data
+
+def crc16(data):
+    # CRC-16/CCITT, same as CRC16() in the firmware
+    crc = 0xffff
+    for c in data:
+        crc ^= c << 8
+        for i in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xffff
+    return crc
+
+def probe(ser, size=probe_size):
+    # returns the bytes per second of a probe burst, None if it did not arrive intact
+    ser.write(b'PROBE %d\n' % size)
+    if read_reply_line(ser, '#PROBE') is None:
+        return None
+    start = time.time()
+    data = read_exact(ser, size)
+    elapsed = time.time() - start
+    line = read_reply_line(ser, '#CRC')
+    if read_reply_line(ser, '#OK') is None or line is None or len(data) != size:
+        return None
+    if int(line.split()[1], 16) != crc16(data):
+        return None
+    return size / elapsed
+
+def fall_back(ser, baud):
+    # the board goes back on its own link_timeout after BAUD, probe at the old rate until it answers
+    ser.baudrate = baud
+    deadline = time.time() + link_timeout + 2 * reply_timeout
+    while time.time() < deadline:
+        ser.reset_input_buffer()
+        if probe(ser, check_size) is not None:
+            return True
+    print('The board did not come back to %d baud, reset it' % baud)
+    return False
+
+def negotiate_link(ser):
+    ser.write(b'BAUDS\n')
+    line = read_reply_line(ser, '#BAUDS')
+    if line is None or read_reply_line(ser, '#OK') is None:
+        print('No reply to BAUDS')
+        return False
+    best = ser.baudrate
+    speed = probe(ser)
+    if speed is None:
+        print('Probe failed at %d baud' % best)
+        return False
+    print('%7d baud: %8.0f bytes/s, about %6.0f samples/s' % (best, speed, speed / bytes_per_sample))
+
+    for rate in [int(r) for r in line.split()[1:]]:
+        if rate <= best:
+            continue
+        ser.write(b'BAUD %d\n' % rate)
+        if read_reply_line(ser, '#OK') is None:
+            # refused, or the reply was lost and the board may have switched anyway
+            if not fall_back(ser, best):
+                return False
+            break
+        try:
+            ser.baudrate = rate
+        except (ValueError, serial.SerialException):
+            print('%7d baud: not supported by this serial port' % rate)
+            if not fall_back(ser, best):
+                return False
+            break
+        time.sleep(0.05)
+        ser.reset_input_buffer()
+        speed = probe(ser)
+        if speed is not None:
+            ser.write(b'COMMIT\n')
+            if read_reply_line(ser, '#OK') is None:
+                speed = None
+        if speed is None:
+            print('%7d baud: probe failed' % rate)
+            if not fall_back(ser, best):
+                return False
+            break
+        best = rate
+        print('%7d baud: %8.0f bytes/s, about %6.0f samples/s' % (best, speed, speed / bytes_per_sample))
+
+    if probe(ser, check_size) is None:
+        print('Link check failed at %d baud, reset the board' % best)
+        return False
+    print('Link settled at %d baud, one stop bit: python temp_stripchart.py --baud %d' % (best, best))
+    return True
+
+def decode_page(page):
+    # every sample: ADC code in bits 0-9, time since the previous sample in bits 10-23 as a count
+    # of log_tick_ms << (log_scale_shift * scale)
+    seq, time_ms, count, channel = struct.unpack_from(page_header, page)
+    start = struct.calcsize(page_header)
+    for n in range(min(count, log_samples)):
+        entry = int.from_bytes(page[start + 3 * n:start + 3 * n + 3], 'little')
+        if n > 0:
+            delta = entry >> 10
+            units = delta & ((1 << log_delta_bits) - 1)
+            time_ms += (units << (log_scale_shift * (delta >> log_delta_bits))) * log_tick_ms
+        yield seq, time_ms, channel, entry & 0x3ff
+
+def load_tables(filename):
+    # lin_table rows of the generated header, and the segment size
+    text = open(filename).read()
+    bits = int(re.search(r'#define LIN_SEGMENT_BITS (\d+)', text).group(1))
+    body = text[text.index('lin_table'):]
+    tables = [[int(v) for v in row.split(',')] for row in re.findall(r'\{([-\d,\s]+)\}', body)]
+    return tables, bits
+
+def linearize(tables, bits, channel, adc):
+    # same integer interpolation as Linearize() in the firmware, in hundredths of a degree
+    table = tables[channel]
+    seg, frac = adc >> bits, adc & ((1 << bits) - 1)
+    return table[seg] + (((table[seg + 1] - table[seg]) * frac) >> bits)
+
+def dump_log(ser, filename):
+    ser.write(b'DUMP\n')
+    line = read_reply_line(ser, '#DUMP')
+    if line is None:
+        print('No reply to DUMP')
+        return False
+    size = int(line.split()[1]) * page_size
+    data = read_exact(ser, size)
+    if len(data) < size:
+        print('Dump stopped after %d of %d bytes' % (len(data), size))
+        return False
+    read_reply_line(ser, '#OK')
+
+    samples = []
+    for start in range(0, size, page_size):
+        samples.extend(decode_page(data[start:start + page_size]))
+    samples.sort() # by page sequence number, then time
+    tables, bits = load_tables(table_file)
+    with open(filename, 'w') as f:
+        f.write('time_s,channel,adc,temperature\n')
+        for seq, time_ms, channel, adc in samples:
+            f.write('%.3f,%d,%d,%.3f\n' % (time_ms / 1000.0, channel, adc, linearize(tables, bits, channel, adc) / 100.0))
+    print('%d pages, %d samples saved to %s' % (size // page_size, len(samples), filename))
+    return True
+
+parser = argparse.ArgumentParser(description='Configure the temperature logger')
+parser.add_argument('--port', default='COM8', help='serial port of the board')
+parser.add_argument('--baud', type=int, default=115200)
+parser.add_argument('--dump', metavar='FILE', help='save the flash log of the board as csv')
+parser.add_argument('--link', action='store_true', help='move the link to the fastest baud rate that works')
+parser.add_argument('commands', nargs='*', help='commands to send, e.g. "RATE 250"')
+args = parser.parse_args()
+
+# configure the serial port
+try:
+    ser = serial.Serial(
+        port = args.port,
+        baudrate = args.baud,
+        parity = serial.PARITY_NONE,
+        stopbits = serial.STOPBITS_ONE,
+        bytesize = serial.EIGHTBITS,
+        timeout = 0.1
+    )
+except serial.SerialException:
+    portlist = list(serial.tools.list_ports.comports())
+    print('Available serial ports:')
+    for item in portlist:
+        print(item[0])
+    sys.exit(1)
+
+ser.reset_input_buffer()
+ok = all([send_command(ser, command) for command in args.commands])
+if args.link:
+    ok = negotiate_link(ser) and ok
+if args.dump:
+    ok = dump_log(ser, args.dump) and ok
+ser.close()
+sys.exit(0 if ok else 1)
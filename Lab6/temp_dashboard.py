@@ -0,0 +1,294 @@
+# Authors:
+#   Kerem Oktay
+#   Idil Bil
+#
+# Functionality:
+#   Headless live dashboard server. Reads the temperature lines of one or more boards, keeps the
+#   last readings of each board in memory and sends them to any number of local viewers.
+#
+#   Server:
+#       python temp_dashboard.py serve --board lab=/dev/ttyUSB0 --board hall=/dev/pts/3
+#       python temp_dashboard.py serve --board lab=/dev/ttyUSB0 --listen tcp:127.0.0.1:2910
+#   Viewer (prints the new readings of one board as they arrive):
+#       python temp_dashboard.py watch lab
+#
+#   Protocol, one text line per request:
+#       BOARDS                  ->  BOARDS <name> <name> ...
+#       GET <board> <cursor>    ->  one "<seq> <time> <values...>" line per reading newer than the
+#                                   cursor, then "END <seq of the last reading>"
+#       WATCH <board> <cursor>  ->  like GET but keeps sending new readings as they arrive
+#   A new client starts with cursor -1 and uses the last sequence number it received after that,
+#   so it only gets what it has not seen. Sequence numbers jump when the client fell behind more
+#   than the history kept by the server. A cursor past the newest reading comes from before a
+#   restart of the server, the client is sent everything again as if its cursor was -1.
+#
+# Note:
+#   Only the Python standard library is used, no matplotlib or pyserial. Serial ports are opened
+#   with termios so this runs on Linux/macOS, a pty works as a stand-in for a board.
+#   Memory is flat: every board keeps a fixed number of readings and a viewer that does not read
+#   its socket is disconnected once its send buffer is full.
+
+import argparse
+import os, sys, time, socket, selectors, termios, tty
+
+history_size = 100000        # readings kept per board
+max_get_lines = 5000         # readings sent per GET, the client asks again with the new cursor
+max_client_buffer = 1 << 20  # bytes queued for a viewer before it is dropped
+reopen_delay = 1.0           # seconds between attempts to open a board that went away
+
+class Board:
+    # fixed size ring of readings indexed by sequence number
+    def __init__(self, name, device, baud):
+        self.name = name
+        self.device = device
+        self.baud = baud
+        self.fd = None
+        self.partial = b''
+        self.ring = [None] * history_size
+        self.seq = -1 # sequence number of the newest reading
+        self.watchers = set()
+        self.next_open = 0.0
+
+    def open(self):
+        self.fd = os.open(self.device, os.O_RDONLY | os.O_NOCTTY | os.O_NONBLOCK)
+        if os.isatty(self.fd):
+            tty.setraw(self.fd)
+            attrs = termios.tcgetattr(self.fd)
+            speed = getattr(termios, 'B%d' % self.baud)
+            attrs[4] = attrs[5] = speed # input and output speed
+            termios.tcsetattr(self.fd, termios.TCSANOW, attrs)
+        self.partial = b''
+
+    def close(self):
+        os.close(self.fd)
+        self.fd = None
+        self.next_open = time.time() + reopen_delay
+
+    def add_lines(self, data):
+        # returns the encoded new readings, ready to send to the watchers
+        lines = (self.partial + data).split(b'\n')
+        self.partial = lines.pop()[-256:] # a line that never ends is garbage, keep memory flat
+        now = time.time()
+        out = []
+        for line in lines:
+            fields = line.split()
+            # skip command replies (they start with '#') and lines garbled by a reset
+            try:
+                values = [float(x) for x in fields]
+            except ValueError:
+                continue
+            if not values:
+                continue
+            self.seq += 1
+            entry = ('%d %.3f %s\n' % (self.seq, now, ' '.join('%g' % v for v in values))).encode('ascii')
+            self.ring[self.seq % history_size] = entry
+            out.append(entry)
+        return b''.join(out)
+
+    def since(self, cursor, limit):
+        first = max(cursor + 1, self.seq - history_size + 1, 0)
+        last = min(self.seq, first + limit - 1)
+        return b''.join(self.ring[seq % history_size] for seq in range(first, last + 1)), last
+
+class Client:
+    def __init__(self, sock):
+        self.sock = sock
+        self.inbuf = b''
+        self.outbuf = bytearray()
+        self.watching = None
+        self.closed = False
+
+class Server:
+    def __init__(self, boards, listen):
+        self.boards = dict((b.name, b) for b in boards)
+        self.sel = selectors.DefaultSelector()
+        self.listener = self.make_listener(listen)
+        self.sel.register(self.listener, selectors.EVENT_READ, 'listen')
+
+    def make_listener(self, listen):
+        kind, _, where = listen.partition(':')
+        if kind == 'tcp':
+            host, _, port = where.rpartition(':')
+            sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+            sock.bind((host or '127.0.0.1', int(port)))
+        else:
+            if os.path.exists(where):
+                os.unlink(where)
+            sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            sock.bind(where)
+        sock.listen(64)
+        sock.setblocking(False)
+        return sock
+
+    def send(self, client, data):
+        if not data or client.closed:
+            return
+        if len(client.outbuf) + len(data) > max_client_buffer:
+            self.drop(client) # viewer is not keeping up
+            return
+        if not client.outbuf:
+            self.sel.modify(client.sock, selectors.EVENT_READ | selectors.EVENT_WRITE, client)
+        client.outbuf += data
+
+    def drop(self, client):
+        # can be called again for a client that is already gone, e.g. dropped while a board was
+        # read and then seen by the select() results of the same round
+        if client.closed:
+            return
+        client.closed = True
+        if client.watching:
+            client.watching.watchers.discard(client)
+        self.sel.unregister(client.sock)
+        client.sock.close()
+
+    def handle_request(self, client, line):
+        fields = line.decode('ascii', errors='replace').split()
+        if not fields:
+            return
+        command = fields[0].upper()
+        if command == 'BOARDS':
+            self.send(client, ('BOARDS %s\n' % ' '.join(self.boards)).encode('ascii'))
+            return
+        if command in ('GET', 'WATCH') and len(fields) == 3 and fields[1] in self.boards:
+            board = self.boards[fields[1]]
+            try:
+                cursor = int(fields[2])
+            except ValueError:
+                cursor = -1
+            if cursor > board.seq:
+                cursor = -1 # from before the server restarted
+            if command == 'GET':
+                data, last = board.since(cursor, max_get_lines)
+                self.send(client, data + ('END %d\n' % last).encode('ascii'))
+            else:
+                if client.watching:
+                    client.watching.watchers.discard(client)
+                client.watching = board
+                board.watchers.add(client)
+                # catch up with at most max_get_lines readings, then only new ones
+                data, last = board.since(max(cursor, board.seq - max_get_lines), max_get_lines)
+                self.send(client, data)
+            return
+        self.send(client, b'ERR ' + line + b'\n')
+
+    def read_client(self, client):
+        try:
+            data = client.sock.recv(4096)
+        except (BlockingIOError, InterruptedError):
+            return
+        except OSError:
+            data = b''
+        if not data:
+            self.drop(client)
+            return
+        lines = (client.inbuf + data).split(b'\n')
+        client.inbuf = lines.pop()[-256:]
+        for line in lines:
+            self.handle_request(client, line.strip())
+            if client.closed:
+                return # dropped while answering
+
+    def write_client(self, client):
+        try:
+            sent = client.sock.send(client.outbuf)
+        except (BlockingIOError, InterruptedError):
+            return
+        except OSError:
+            self.drop(client)
+            return
+        del client.outbuf[:sent]
+        if not client.outbuf:
+            self.sel.modify(client.sock, selectors.EVENT_READ, client)
+
+    def read_board(self, board):
+        try:
+            data = os.read(board.fd, 65536)
+        except (BlockingIOError, InterruptedError):
+            return
+        except OSError:
+            data = b''
+        if not data:
+            print('%s: %s closed' % (board.name, board.device), file=sys.stderr)
+            self.sel.unregister(board.fd)
+            board.close()
+            return
+        new = board.add_lines(data)
+        if new:
+            for client in list(board.watchers):
+                self.send(client, new)
+
+    def open_boards(self):
+        now = time.time()
+        for board in self.boards.values():
+            if board.fd is None and now >= board.next_open:
+                try:
+                    board.open()
+                except OSError:
+                    board.next_open = now + reopen_delay
+                    continue
+                self.sel.register(board.fd, selectors.EVENT_READ, board)
+
+    def run(self):
+        while True:
+            self.open_boards()
+            for key, events in self.sel.select(timeout=reopen_delay):
+                if key.data == 'listen':
+                    sock, _ = self.listener.accept()
+                    sock.setblocking(False)
+                    self.sel.register(sock, selectors.EVENT_READ, Client(sock))
+                elif isinstance(key.data, Board):
+                    self.read_board(key.data)
+                else:
+                    if events & selectors.EVENT_READ and not key.data.closed:
+                        self.read_client(key.data)
+                    if events & selectors.EVENT_WRITE and not key.data.closed:
+                        self.write_client(key.data)
+
+def connect(listen):
+    kind, _, where = listen.partition(':')
+    if kind == 'tcp':
+        host, _, port = where.rpartition(':')
+        return socket.create_connection((host or '127.0.0.1', int(port)))
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(where)
+    return sock
+
+def watch(listen, board):
+    sock = connect(listen)
+    sock.sendall(('WATCH %s -1\n' % board).encode('ascii'))
+    for line in sock.makefile('r'):
+        print(line, end='', flush=True)
+
+def parse_board(text):
+    name, _, device = text.partition('=')
+    device, _, baud = device.partition('@')
+    if not name or not device:
+        raise argparse.ArgumentTypeError('expected NAME=DEVICE[@BAUD]')
+    baud = baud or '115200'
+    # termios only has the standard rates, check here instead of failing when the port is opened
+    if not baud.isdigit() or not hasattr(termios, 'B' + baud):
+        rates = sorted(int(n[1:]) for n in dir(termios) if n[0] == 'B' and n[1:].isdigit())
+        raise argparse.ArgumentTypeError('%s: baud rate %s is not one of %s' %
+                                         (text, baud, ' '.join(str(r) for r in rates if r >= 9600)))
+    return Board(name, device, int(baud))
+
+common = argparse.ArgumentParser(add_help=False)
+common.add_argument('--listen', default='unix:/tmp/temp_dashboard.sock',
+                    help='unix:PATH or tcp:HOST:PORT')
+parser = argparse.ArgumentParser(description='Live temperature dashboard server')
+sub = parser.add_subparsers(dest='command', required=True)
+p = sub.add_parser('serve', parents=[common], help='read the boards and serve the viewers')
+p.add_argument('--board', type=parse_board, action='append', required=True,
+               help='NAME=DEVICE[@BAUD], can be given more than once')
+p = sub.add_parser('watch', parents=[common], help='print the readings of one board')
+p.add_argument('board')
+args = parser.parse_args()
+
+try:
+    if args.command == 'serve':
+        Server(args.board, args.listen).run()
+    else:
+        watch(args.listen, args.board)
+except KeyboardInterrupt:
+    pass
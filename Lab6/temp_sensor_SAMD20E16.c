@@ -17,11 +17,41 @@
  *
  * Note:
  * 	Parts of this code are taken from examples provided for SAMD20E16
+ *	The ADC codes are converted with the tables in linearize.h, regenerate it when a sensor or
+ *	VREF changes:
+ *		python gen_linearize.py --vref 3.3 --target arm -o ../Lab6/linearize.h
+ *
+ * Serial commands (one per line, replies start with '#'):
+ *	RATE <ms>        time between samples
+ *	CH <mask>        bit mask of MCP3008 channels to sample (e.g. 0x03 for CH0 and CH1)
+ *	COLD <degrees>   below this temperature the room is COLD, has to be below HOT
+ *	HOT <degrees>    above this temperature the room is HOT
+ *	MODE C|V|RAW     print celcius degrees, volts or raw ADC codes
+ *	AVG <n>          average n samples before printing
+ *	ADAPT 0|1        adaptive sampling: slow down to MAXRATE while every selected channel is steady
+ *	MAXRATE <ms>     longest time between samples in adaptive mode
+ *	DEADBAND <deg>   only print when a channel moved this much since the last print (0 prints all)
+ *	STATS            print the number of ADC conversions and bytes sent since reset
+ *	LOG 0|1          keep the readings of the first channel in flash, even with no PC connected
+ *	DUMP             send the flash log: "#DUMP <pages>", the raw 64-byte pages oldest first, "#END"
+ *	ERASELOG         empty the flash log
+ *	BAUDS            list the baud rates this clock can make within BAUD_TOLERANCE
+ *	BAUD <rate>      switch to the rate after "#OK", goes back unless COMMIT arrives in LINK_TIMEOUT_MS
+ *	PROBE <n>        send "#PROBE <n>", n test bytes and "#CRC <crc16 of the bytes>" to check the link
+ *	COMMIT           keep the new baud rate
+ *	SAVE             store the settings in flash so they survive a reset
+ *	DEFAULTS         go back to the compiled in settings
+ *	SHOW             print the current settings
+ *	Numbers are decimal, a leading 0x makes them hex. A line that lost characters on the way in
+ *	(USART overflow, framing error) is answered with #ERR and not run.
  */
 
 #include "samd20.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "linearize.h" // generated by Tools/gen_linearize.py
 
 void init_Clock48(void);
 void UART3_init(uint32_t baud);
@@ -188,56 +218,909 @@ unsigned int GetADC(char channel)
 }
 
 #define VREF 3.3
- 
-int main(void) 
+
+// The settings are kept in the last row of the 64KB flash. The program is much smaller than that,
+// so the linker never places code there.
+#define NVM_PAGE_SIZE 64
+#define NVM_ROW_SIZE (4*NVM_PAGE_SIZE)
+#define SETTINGS_ADDR (0x10000-NVM_ROW_SIZE)
+#define SETTINGS_MAGIC 0x54454D33 // "TEM3", changed whenever settings_t changes
+
+// Flash starts at address 0. The simulator in sim/ compiles this file on the PC and points
+// FLASH_BASE at its own copy of the flash.
+#ifndef FLASH_BASE
+#define FLASH_BASE 0
+#endif
+#define FLASH_PTR(addr) ((uintptr_t)FLASH_BASE + (addr))
+
+// The rows between LOG_START and the settings row are a circular log of readings. Writing the
+// pages in a circle spreads the erases evenly over all the rows.
+#define LOG_START 0xC000
+#define LOG_END SETTINGS_ADDR
+#define LOG_SAMPLES 18      // 3-byte samples that fit in a page after the header
+#define LOG_TICK_MS 4       // unit of the time between two samples of a page
+#define LOG_DELTA_BITS 12   // the 14-bit time between two samples: a count in bits 0-11 and a scale
+#define LOG_DELTA_MAX 4095  // in bits 12-13, the count is in LOG_TICK_MS << (LOG_SCALE_SHIFT * scale)
+#define LOG_SCALE_SHIFT 4   // scales up to 16s in 4ms, 4min in 64ms, 70min in 1s and 18h in 16s units
+
+// End of the program in flash: the code and the initial values of the variables that are copied
+// to RAM at reset, both placed by the linker script. Logging is refused if it reaches LOG_START,
+// ERASELOG would wipe part of the program.
+#ifndef FLASH_USED
+extern uint32_t _etext, _srelocate, _erelocate;
+#define FLASH_USED ((uint32_t)&_etext + ((uint32_t)&_erelocate - (uint32_t)&_srelocate))
+#endif
+
+#define OUT_CELSIUS 0
+#define OUT_VOLTS   1
+#define OUT_RAW     2
+
+#define NUM_CHANNELS 8
+#define CMD_LEN 32
+
+#define TEMP_MIN -55.0      // COLD/HOT limits outside the range of the sensors are typing mistakes
+#define TEMP_MAX 150.0
+#define NEAR_LIMIT 1.0       // sample at full rate when this close (in degrees) to the COLD/HOT limits
+#define STEADY_LSB 1.5       // ADC steps from the settled temperature that count as a change, one step either way is noise
+#define STEADY_WEIGHT 0.25   // how fast the settled temperature follows the readings
+#define NO_TEMP 1000.0       // settled temperature before the first reading
+#define HEARTBEAT_MS 60000L  // print at least this often even inside the deadband
+
+typedef struct
+{
+	uint32_t magic;
+	uint16_t period_ms;  // time between samples
+	uint8_t  channels;   // bit mask of MCP3008 channels to sample
+	uint8_t  out_mode;   // OUT_CELSIUS, OUT_VOLTS or OUT_RAW
+	uint8_t  avg_window; // number of samples averaged before printing
+	uint8_t  adaptive;   // 1: the time between samples grows up to max_period_ms while the temperature is steady
+	uint16_t max_period_ms;
+	float    cold_limit; // below this temperature the room is COLD
+	float    hot_limit;  // above this temperature the room is HOT
+	float    deadband;   // degrees a channel must move before it is printed again, 0 prints every reading
+	uint8_t  log_enable; // 1: readings of the first channel are written to the flash log
+	uint8_t  unused[3];
+} settings_t;
+
+typedef struct
+{
+	uint32_t seq;     // counts up with every page written, 0xffffffff if the page is erased
+	uint32_t time_ms; // log time of the first sample
+	uint8_t  count;   // number of samples in this page
+	uint8_t  channel;
+	uint8_t  data[NVM_PAGE_SIZE-10]; // 3 bytes per sample, little endian: ADC code in bits 0-9, time since
+	                                 // the previous sample in bits 10-23 (0 for the first one), see LOG_DELTA_BITS
+} log_page_t;
+
+//NOTE: THESE BOUNDARY VALUES ARE CHOSEN FOR DEMONSTRATION, NORMAL CONDITIONS CAN BE HIGHER OR LOWER FOR HOT AND COLD STATES
+const settings_t default_settings = {SETTINGS_MAGIC, 100, 0x01, OUT_CELSIUS, 1, 0, 2000, 22.0, 30.0, 0.0, 0, {0, 0, 0}};
+settings_t settings;
+
+// Counters for the STATS command
+uint32_t num_conversions = 0;
+uint32_t bytes_sent = 0;
+
+// Page being filled in RAM, written to flash when it is full
+union
+{
+	log_page_t page;
+	uint32_t words[NVM_PAGE_SIZE/4];
+} log_buff;
+uint32_t log_addr = LOG_START; // next page to write, the oldest page in the log
+uint32_t log_seq = 0;          // sequence number of the next page
+uint32_t log_offset = 0;       // log time at reset: Millis() continues from the end of the log
+uint32_t log_last_ms;          // log time of the previous sample of the page, in whole LOG_TICK_MS steps
+int log_ok = 1;                // 0 if the program grew into the log rows
+
+// Free running millisecond clock, see RTC_Init()
+uint32_t rtc_last = 0;
+uint32_t rtc_wraps = 0;
+
+// Baud rates the host can try, the board always starts at the first one
+#define BAUD_TOLERANCE 2.0   // percent
+#define LINK_TIMEOUT_MS 2000 // without COMMIT a new rate is dropped after this long
+#define PROBE_MAX 65535
+const uint32_t link_rates[] = {115200, 230400, 460800, 921600, 1000000, 1500000, 2000000, 3000000};
+uint32_t link_baud = 115200;
+uint32_t link_prev_baud = 115200;
+uint32_t link_new_baud = 0;     // set by BAUD, the switch happens once the reply is out
+uint32_t link_deadline = 0;
+int link_pending = 0;           // 1 while waiting for COMMIT
+
+float steady_temp[NUM_CHANNELS]; // temperature the adaptive sampling settled at, per channel
+
+// Filled by the receive interrupt, processed by the main loop
+volatile char cmd_buff[CMD_LEN];
+volatile int cmd_len = 0;
+volatile int cmd_ready = 0;
+volatile int cmd_bad = 0;      // characters of the line being received were lost
+volatile int cmd_line_bad = 0; // cmd_bad of the line in cmd_buff
+
+void NVM_Command (uint32_t cmd, uint32_t addr)
+{
+	while (NVMCTRL->INTFLAG.bit.READY == 0) {}   // wait for the previous command to finish
+	NVMCTRL->STATUS.reg = NVMCTRL_STATUS_MASK;    // clear the error flags
+	NVMCTRL->ADDR.reg = addr / 2;                 // ADDR is in 16-bit words
+	NVMCTRL->CTRLA.reg = cmd | NVMCTRL_CTRLA_CMDEX_KEY;
+	while (NVMCTRL->INTFLAG.bit.READY == 0) {}
+}
+
+void NVM_EraseRow (uint32_t addr)
+{
+	NVM_Command(NVMCTRL_CTRLA_CMD_ER, addr);
+}
+
+void NVM_WritePage (uint32_t addr, const uint32_t * data)
+{
+	volatile uint32_t * dst = (volatile uint32_t *)FLASH_PTR(addr);
+	int i;
+
+	NVMCTRL->CTRLB.bit.MANW = 1; // Only write the page when asked to
+	NVM_Command(NVMCTRL_CTRLA_CMD_PBC, addr); // clear the page buffer
+	for(i = 0; i < NVM_PAGE_SIZE/4; i++) dst[i] = data[i]; // fill the page buffer, flash only takes 32-bit writes
+	NVM_Command(NVMCTRL_CTRLA_CMD_WP, addr);
+}
+
+void Load_Settings (void)
+{
+	const settings_t * saved = (const settings_t *)FLASH_PTR(SETTINGS_ADDR);
+
+	// erased flash reads as 0xff, so anything without the magic number was never saved
+	if ((saved->magic == SETTINGS_MAGIC) && (saved->period_ms > 0) && (saved->channels != 0) &&
+	    (saved->out_mode <= OUT_RAW) && (saved->avg_window > 0) && (saved->max_period_ms >= saved->period_ms) &&
+	    (saved->cold_limit >= TEMP_MIN) && (saved->cold_limit < saved->hot_limit) && (saved->hot_limit <= TEMP_MAX))
+	{
+		settings = *saved;
+	}
+	else
+	{
+		settings = default_settings;
+	}
+}
+
+void Save_Settings (void)
+{
+	uint32_t page[NVM_PAGE_SIZE/4];
+
+	memset(page, 0xff, sizeof(page));
+	memcpy(page, &settings, sizeof(settings));
+	NVM_EraseRow(SETTINGS_ADDR);
+	NVM_WritePage(SETTINGS_ADDR, page);
+}
+
+void Show_Settings (void)
+{
+	printf("#RATE %u\n", settings.period_ms);
+	printf("#CH 0x%02x\n", settings.channels);
+	printf("#COLD %.2f\n", settings.cold_limit);
+	printf("#HOT %.2f\n", settings.hot_limit);
+	printf("#MODE %s\n", settings.out_mode == OUT_RAW ? "RAW" : (settings.out_mode == OUT_VOLTS ? "V" : "C"));
+	printf("#AVG %u\n", settings.avg_window);
+	printf("#ADAPT %u\n", settings.adaptive);
+	printf("#MAXRATE %u\n", settings.max_period_ms);
+	printf("#DEADBAND %.2f\n", settings.deadband);
+	printf("#LOG %u\n", settings.log_enable);
+}
+
+// The samples are timestamped and scheduled with the RTC, not SysTick, since delayMs() reprograms
+// SysTick and the LCD and the flash take time outside of any wait. Generator 3 divides the 48MHz
+// DFLL down to 1MHz and the RTC prescaler by 1024, COUNT goes up every 1.024ms.
+void RTC_Init (void)
+{
+	GCLK->GENDIV.reg = GCLK_GENDIV_ID(3) | GCLK_GENDIV_DIV(48);
+	GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(3) | GCLK_GENCTRL_SRC_DFLL48M | GCLK_GENCTRL_GENEN;
+	while (GCLK->STATUS.bit.SYNCBUSY) {}
+	GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID(RTC_GCLK_ID) | GCLK_CLKCTRL_CLKEN | GCLK_CLKCTRL_GEN(3); // the RTC bus clock is on after reset
+
+	RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_MODE_COUNT32 | RTC_MODE0_CTRL_PRESCALER_DIV1024;
+	RTC->MODE0.READREQ.reg = RTC_READREQ_RREQ | RTC_READREQ_RCONT; // keep COUNT readable without waiting
+	RTC->MODE0.CTRL.reg |= RTC_MODE0_CTRL_ENABLE;
+	while (RTC->MODE0.STATUS.bit.SYNCBUSY) {}
+}
+
+// Milliseconds since reset. COUNT wraps after 50 days, the wraps are counted here as long as
+// Millis() is called more often than that.
+uint32_t Millis (void)
+{
+	uint32_t count = RTC->MODE0.COUNT.reg;
+
+	if (count < rtc_last) rtc_wraps++;
+	rtc_last = count;
+	return ((((uint64_t)rtc_wraps << 32) | count) * 128) / 125; // 1.024ms per count
+}
+
+// LOG_TICK_MS steps since the previous sample
+uint32_t Log_Steps (const uint8_t * entry)
+{
+	uint32_t delta = (entry[1] >> 2) | (entry[2] << 6);
+
+	return (delta & LOG_DELTA_MAX) << (LOG_SCALE_SHIFT * (delta >> LOG_DELTA_BITS));
+}
+
+// Find the newest page so logging carries on after it
+void Log_Init (void)
+{
+	const log_page_t * p;
+	const log_page_t * newest = NULL;
+	uint32_t addr;
+	int i;
+
+	if (FLASH_USED > LOG_START)
+	{
+		log_ok = 0;
+		return;
+	}
+
+	for(addr = LOG_START; addr < LOG_END; addr += NVM_PAGE_SIZE)
+	{
+		p = (const log_page_t *)FLASH_PTR(addr);
+		if (p->seq == 0xffffffff) continue; // erased
+		if ((newest == NULL) || (p->seq > newest->seq))
+		{
+			newest = p;
+			log_addr = addr + NVM_PAGE_SIZE;
+		}
+	}
+
+	if (newest != NULL)
+	{
+		log_seq = newest->seq + 1;
+		if (log_addr >= LOG_END) log_addr = LOG_START;
+		// the log time goes on from the last sample, the time the board was off is not known
+		log_offset = newest->time_ms;
+		for(i = 1; (i < newest->count) && (i < LOG_SAMPLES); i++)
+		{
+			log_offset += Log_Steps(&newest->data[3*i]) * LOG_TICK_MS;
+		}
+	}
+	log_buff.page.count = 0;
+}
+
+// Write the page in RAM to flash. The CPU stalls while flash is erased or written, a character
+// arriving on the serial port at that moment can be lost.
+void Log_Flush (void)
+{
+	if (log_buff.page.count == 0) return;
+
+	if ((log_addr % NVM_ROW_SIZE) == 0) NVM_EraseRow(log_addr); // first page of a row, drops the oldest 4 pages
+	log_buff.page.seq = log_seq++;
+	NVM_WritePage(log_addr, log_buff.words);
+
+	log_addr += NVM_PAGE_SIZE;
+	if (log_addr >= LOG_END) log_addr = LOG_START;
+	log_buff.page.count = 0;
+}
+
+// Every sample carries the time since the previous one, so changes of the sample period (ADAPT,
+// RATE, commands) do not cost a page. Long gaps (MAXRATE or RATE times AVG) are counted in a
+// coarser unit, what does not fit the unit is carried to the next sample like any other rest.
+void Log_Sample (int channel, unsigned int adc)
+{
+	uint32_t now, steps, delta;
+	int scale;
+	uint8_t * entry;
+
+	if (!settings.log_enable || !log_ok) return;
+
+	now = log_offset + Millis();
+	steps = (now - log_last_ms) / LOG_TICK_MS;
+	for(scale = 0; (scale < 3) && ((steps >> (LOG_SCALE_SHIFT * scale)) > LOG_DELTA_MAX); scale++) {}
+	delta = steps >> (LOG_SCALE_SHIFT * scale);
+
+	// a page has one channel, start a new one if it changed or the gap does not fit
+	if ((log_buff.page.count > 0) && ((log_buff.page.channel != channel) || (delta > LOG_DELTA_MAX))) Log_Flush();
+
+	if (log_buff.page.count == 0)
+	{
+		log_buff.page.time_ms = now;
+		log_buff.page.channel = channel;
+		memset(log_buff.page.data, 0xff, sizeof(log_buff.page.data));
+		log_last_ms = now;
+		delta = 0;
+		scale = 0;
+	}
+	log_last_ms += (delta << (LOG_SCALE_SHIFT * scale)) * LOG_TICK_MS; // the rest of the unit is carried to the next sample, the times do not drift
+	delta |= scale << LOG_DELTA_BITS;
+
+	entry = &log_buff.page.data[3 * log_buff.page.count];
+	entry[0] = adc & 0xff;
+	entry[1] = ((adc >> 8) & 0x03) | (delta << 2);
+	entry[2] = delta >> 6;
+
+	if (++log_buff.page.count == LOG_SAMPLES) Log_Flush();
+}
+
+void UART3_putc (uint8_t c)
 {
-	float temp_Volts;
+	while (SERCOM3->USART.INTFLAG.bit.DRE == 0) {}
+	SERCOM3->USART.DATA.reg = c;
+}
+
+// Send every page of the log, oldest first, straight to the UART at full line rate
+void Log_Dump (void)
+{
+	const uint8_t * p;
+	uint32_t addr;
+	uint32_t pages = 0;
+	int i;
+
+	Log_Flush();
+
+	for(addr = LOG_START; addr < LOG_END; addr += NVM_PAGE_SIZE)
+	{
+		if (((const log_page_t *)FLASH_PTR(addr))->seq != 0xffffffff) pages++;
+	}
+	printf("#DUMP %lu\n", (unsigned long)pages);
+	fflush(stdout);
+
+	addr = log_addr;
+	do
+	{
+		p = (const uint8_t *)FLASH_PTR(addr);
+		if (((const log_page_t *)p)->seq != 0xffffffff)
+		{
+			for(i = 0; i < NVM_PAGE_SIZE; i++) UART3_putc(p[i]);
+		}
+		addr += NVM_PAGE_SIZE;
+		if (addr >= LOG_END) addr = LOG_START;
+	} while (addr != log_addr);
+
+	printf("#END\n");
+}
+
+void Log_Erase (void)
+{
+	uint32_t addr;
+
+	for(addr = LOG_START; addr < LOG_END; addr += NVM_ROW_SIZE) NVM_EraseRow(addr);
+	log_addr = LOG_START;
+	log_seq = 0;
+	log_buff.page.count = 0;
+}
+
+// Receive interrupt: collect characters until end of line. The line is handed to the main loop
+// through cmd_ready so nothing slow runs inside the interrupt.
+// A line that lost characters is still handed over but marked bad: a flash erase stalls the CPU
+// for about 6ms, long enough to lose a whole line with its end, and the rest of two lines run
+// together can be a valid command.
+void SERCOM3_Handler (void)
+{
+	uint16_t status = SERCOM3->USART.STATUS.reg;
+	char c = SERCOM3->USART.DATA.reg; // reading DATA clears the RXC flag
+
+	if (status & (SERCOM_USART_STATUS_BUFOVF | SERCOM_USART_STATUS_FERR))
+	{
+		SERCOM3->USART.STATUS.reg = SERCOM_USART_STATUS_BUFOVF | SERCOM_USART_STATUS_FERR; // cleared by writing 1
+		cmd_bad = 1;
+	}
+
+	if ((c == '\r') || (c == '\n'))
+	{
+		if (cmd_ready)
+		{
+			cmd_bad = 0; // the whole line was dropped, there is nothing to answer
+		}
+		else if ((cmd_len > 0) || cmd_bad)
+		{
+			cmd_buff[cmd_len] = 0;
+			cmd_line_bad = cmd_bad;
+			cmd_bad = 0;
+			cmd_ready = 1;
+		}
+	}
+	else if (cmd_ready)
+	{
+		cmd_bad = 1; // previous command not processed yet, drop the character and the rest of its line
+	}
+	else if (cmd_len < CMD_LEN-1)
+	{
+		cmd_buff[cmd_len++] = toupper((unsigned char)c);
+	}
+}
+
+void UART3_RX_init (void)
+{
+	// UART3_init() enables the receiver, only the interrupt has to be turned on
+	SERCOM3->USART.INTENSET.reg = SERCOM_USART_INTENSET_RXC;
+	NVIC_EnableIRQ(SERCOM3_IRQn);
+}
+
+// Error of the rate made by the arithmetic baud generator with 16x oversampling:
+// BAUD = 65536*(1 - 16*baud/F_CPU), rounded to an integer
+float Baud_Error (uint32_t baud)
+{
+	uint64_t reg;
+	float actual;
+
+	if ((uint64_t)16 * baud > F_CPU) return 100.0; // too fast for this clock
+	reg = 65536 - ((uint64_t)65536 * 16 * baud + F_CPU/2) / F_CPU;
+	actual = (float)F_CPU / 16 * (65536 - reg) / 65536;
+	actual = 100 * (actual - baud) / baud;
+	return actual < 0 ? -actual : actual;
+}
+
+int Baud_Supported (uint32_t baud)
+{
+	int i;
+
+	for(i = 0; i < sizeof(link_rates)/sizeof(link_rates[0]); i++)
+	{
+		if ((link_rates[i] == baud) && (Baud_Error(baud) <= BAUD_TOLERANCE)) return 1;
+	}
+	return 0;
+}
+
+void Set_Baud (uint32_t baud)
+{
+	fflush(stdout);
+	while (SERCOM3->USART.INTFLAG.bit.DRE == 0) {} // last character moved to the shift register
+	delayMs(1); // and it has left at the old rate (TXC can not be used, it stays 0 if nothing was sent)
+	UART3_init(baud);
+	cmd_len = 0; // anything received at the other rate is garbage
+	cmd_ready = 0;
+	cmd_bad = 0;
+	UART3_RX_init(); // UART3_init() resets SERCOM3, turn the receive interrupt back on
+	link_baud = baud;
+}
+
+// CRC-16/CCITT, the host checks the probe bytes with the same polynomial
+uint16_t CRC16 (uint16_t crc, uint8_t c)
+{
+	int i;
+
+	crc ^= (uint16_t)c << 8;
+	for(i = 0; i < 8; i++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+	return crc;
+}
+
+// Test bytes from a 16-bit LFSR so every byte value shows up, sent back to back at full rate
+void Send_Probe (uint32_t n)
+{
+	uint16_t lfsr = 0xACE1;
+	uint16_t crc = 0xFFFF;
+	uint8_t c;
+
+	printf("#PROBE %lu\n", (unsigned long)n);
+	fflush(stdout);
+	while (n--)
+	{
+		lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xB400);
+		c = lfsr & 0xff;
+		crc = CRC16(crc, c);
+		UART3_putc(c);
+	}
+	printf("#CRC %04x\n", crc);
+}
+
+// The whole argument has to be a number: "25x" or "" is an error instead of 25 or 0. Decimal,
+// or hex with 0x in front; a leading 0 is not octal, "0250" is 250.
+int Parse_Long (const char * arg, long * value)
+{
+	char * end;
+
+	if ((arg[0] == '0') && (arg[1] == 'X'))
+	{
+		arg += 2;
+		if (!isxdigit((unsigned char)arg[0])) return 0; // strtol would take a sign or a second 0x
+		*value = strtol(arg, &end, 16);
+	}
+	else
+	{
+		*value = strtol(arg, &end, 10);
+	}
+	while (*end == ' ') end++;
+	return (end != arg) && (*end == 0);
+}
+
+int Parse_Float (const char * arg, float * value)
+{
+	char * end;
+	double d = strtod(arg, &end);
+
+	while (*end == ' ') end++;
+	if ((end == arg) || (*end != 0) || (d != d)) return 0; // d != d for "NAN"
+	*value = d;
+	return 1;
+}
+
+void Process_Command (void)
+{
+	char line[CMD_LEN];
+	char * arg;
+	long n;
+	float f;
+	int ok = 1;
+	int bad = cmd_line_bad;
+
+	strcpy(line, (char *)cmd_buff);
+	cmd_len = 0;
+	cmd_ready = 0; // the interrupt can start filling the buffer again
+
+	arg = strchr(line, ' ');
+	if (arg != NULL)
+	{
+		*arg++ = 0;
+		while (*arg == ' ') arg++;
+	}
+
+	if (bad)
+	{
+		ok = 0; // characters were lost, it may be the ends of two commands run together
+	}
+	else if (strcmp(line, "SHOW") == 0)
+	{
+		// nothing to change
+	}
+	else if (strcmp(line, "STATS") == 0)
+	{
+		printf("#CONVERSIONS %lu\n", (unsigned long)num_conversions);
+		printf("#BYTES %lu\n", (unsigned long)bytes_sent);
+	}
+	else if (strcmp(line, "SAVE") == 0)
+	{
+		Save_Settings();
+	}
+	else if (strcmp(line, "DUMP") == 0)
+	{
+		if (log_ok) Log_Dump(); else ok = 0;
+	}
+	else if (strcmp(line, "ERASELOG") == 0)
+	{
+		if (log_ok) Log_Erase(); else ok = 0; // the rows hold part of the program
+	}
+	else if (strcmp(line, "BAUDS") == 0)
+	{
+		printf("#BAUDS");
+		for(n = 0; n < sizeof(link_rates)/sizeof(link_rates[0]); n++)
+		{
+			if (Baud_Supported(link_rates[n])) printf(" %lu", (unsigned long)link_rates[n]);
+		}
+		printf("\n");
+	}
+	else if (strcmp(line, "COMMIT") == 0)
+	{
+		link_pending = 0;
+		printf("#BAUD %lu\n", (unsigned long)link_baud);
+	}
+	else if (strcmp(line, "DEFAULTS") == 0)
+	{
+		settings = default_settings;
+		Log_Flush(); // logging is off by default, keep what was collected so far like LOG 0
+	}
+	else if (arg == NULL)
+	{
+		ok = 0;
+	}
+	else if (strcmp(line, "RATE") == 0)
+	{
+		if (Parse_Long(arg, &n) && (n >= 10) && (n <= 60000)) settings.period_ms = n; else ok = 0;
+		if (settings.max_period_ms < settings.period_ms) settings.max_period_ms = settings.period_ms;
+	}
+	else if (strcmp(line, "MAXRATE") == 0)
+	{
+		if (Parse_Long(arg, &n) && (n >= settings.period_ms) && (n <= 60000)) settings.max_period_ms = n; else ok = 0;
+	}
+	else if (strcmp(line, "ADAPT") == 0)
+	{
+		if (Parse_Long(arg, &n) && ((n == 0) || (n == 1))) settings.adaptive = n; else ok = 0;
+	}
+	else if (strcmp(line, "BAUD") == 0)
+	{
+		if (Parse_Long(arg, &n) && Baud_Supported(n)) link_new_baud = n; else ok = 0;
+	}
+	else if (strcmp(line, "PROBE") == 0)
+	{
+		if (Parse_Long(arg, &n) && (n > 0) && (n <= PROBE_MAX)) Send_Probe(n); else ok = 0;
+	}
+	else if (strcmp(line, "LOG") == 0)
+	{
+		if (Parse_Long(arg, &n) && ((n == 0) || (n == 1)) && log_ok) settings.log_enable = n; else ok = 0;
+		if (!settings.log_enable) Log_Flush(); // keep what was collected so far
+	}
+	else if (strcmp(line, "DEADBAND") == 0)
+	{
+		if (Parse_Float(arg, &f) && (f >= 0) && (f <= TEMP_MAX - TEMP_MIN)) settings.deadband = f; else ok = 0;
+	}
+	else if (strcmp(line, "CH") == 0)
+	{
+		if (Parse_Long(arg, &n) && (n > 0) && (n <= 0xff)) settings.channels = n; else ok = 0;
+	}
+	else if (strcmp(line, "AVG") == 0)
+	{
+		if (Parse_Long(arg, &n) && (n > 0) && (n <= 64)) settings.avg_window = n; else ok = 0;
+	}
+	else if (strcmp(line, "COLD") == 0)
+	{
+		// COLD has to stay below HOT, otherwise no temperature is IDLE
+		if (Parse_Float(arg, &f) && (f >= TEMP_MIN) && (f < settings.hot_limit)) settings.cold_limit = f; else ok = 0;
+	}
+	else if (strcmp(line, "HOT") == 0)
+	{
+		if (Parse_Float(arg, &f) && (f > settings.cold_limit) && (f <= TEMP_MAX)) settings.hot_limit = f; else ok = 0;
+	}
+	else if (strcmp(line, "MODE") == 0)
+	{
+		if (strcmp(arg, "C") == 0) settings.out_mode = OUT_CELSIUS;
+		else if (strcmp(arg, "V") == 0) settings.out_mode = OUT_VOLTS;
+		else if (strcmp(arg, "RAW") == 0) settings.out_mode = OUT_RAW;
+		else ok = 0;
+	}
+	else
+	{
+		ok = 0;
+	}
+
+	if (ok)
+	{
+		Show_Settings();
+		printf("#OK\n");
+	}
+	else
+	{
+		printf("#ERR %s\n", line);
+	}
+	fflush(stdout);
+
+	if (link_new_baud)
+	{
+		// the reply went out at the old rate, the host switches when it sees it
+		if (!link_pending) link_prev_baud = link_baud;
+		Set_Baud(link_new_baud);
+		link_new_baud = 0;
+		link_pending = 1;
+		link_deadline = Millis() + LINK_TIMEOUT_MS;
+	}
+}
+
+// Wait until Millis() reaches the time of the next sample, commands are answered right away.
+// Returns 1 after a command since it may have changed the sample period or the channels.
+int Wait_Until (uint32_t when)
+{
+	uint32_t now;
+
+	while ((int32_t)((now = Millis()) - when) < 0)
+	{
+		if (cmd_ready)
+		{
+			Process_Command();
+			return 1;
+		}
+
+		if (link_pending && ((int32_t)(now - link_deadline) >= 0))
+		{
+			// the host never confirmed the new rate, go back to the one that worked
+			link_pending = 0;
+			Set_Baud(link_prev_baud);
+		}
+	}
+	return 0;
+}
+
+float ADC_to_Volts (unsigned int adc)
+{
+	return (adc*VREF) / 1023.0;
+}
+
+// ADC code to hundredths of a degree: interpolate between two entries of the channel's table
+int Linearize (int channel, unsigned int adc)
+{
+	int y0 = lin_table[channel][adc >> LIN_SEGMENT_BITS];
+	int y1 = lin_table[channel][(adc >> LIN_SEGMENT_BITS) + 1];
+
+	return y0 + (((y1 - y0) * (int)(adc & ((1 << LIN_SEGMENT_BITS) - 1))) >> LIN_SEGMENT_BITS);
+}
+
+float ADC_to_Celsius (int channel, unsigned int adc)
+{
+	return Linearize(channel, adc) / (float)LIN_SCALE;
+}
+
+// Degrees of one ADC step around this code, from the slope of the table segment. It changes with
+// the code for an NTC, the flat ends of a clamped table count as one hundredth.
+float Step_Degrees (int channel, unsigned int adc)
+{
+	int dy = lin_table[channel][(adc >> LIN_SEGMENT_BITS) + 1] - lin_table[channel][adc >> LIN_SEGMENT_BITS];
+
+	if (dy < 0) dy = -dy;
+	if (dy < (1 << LIN_SEGMENT_BITS)) dy = 1 << LIN_SEGMENT_BITS;
+	return dy / (float)(LIN_SCALE << LIN_SEGMENT_BITS);
+}
+
+float Degrees_Apart (int channel, unsigned int adc1, unsigned int adc2)
+{
+	float d = ADC_to_Celsius(channel, adc1) - ADC_to_Celsius(channel, adc2);
+	return d < 0 ? -d : d;
+}
+
+void Reset_Steady (void)
+{
+	int i;
+
+	for(i = 0; i < NUM_CHANNELS; i++) steady_temp[i] = NO_TEMP;
+}
+
+// Adaptive sampling: double the time between samples while the temperature stays in a band around
+// where it settled and go back to the full rate as soon as it leaves the band or gets close to the
+// COLD/HOT limits. The settled temperature is an average of the readings, so one ADC step of noise
+// flickering up and down stays inside the band while a real change leaves it within a few windows.
+// Every selected channel has its own band, any one of them brings back the full rate.
+int Next_Period (int period, const unsigned int * adc)
+{
+	float temp, change, band;
+	int full = 0;
+	int i;
+
+	if (!settings.adaptive) return settings.period_ms;
+
+	for(i = 0; i < NUM_CHANNELS; i++)
+	{
+		if ((settings.channels & (1<<i)) == 0) continue;
+
+		temp = ADC_to_Celsius(i, adc[i]);
+		change = temp - steady_temp[i];
+		if (change < 0) change = -change;
+		band = settings.deadband;
+		if (band < STEADY_LSB * Step_Degrees(i, adc[i])) band = STEADY_LSB * Step_Degrees(i, adc[i]);
+
+		if ((change >= band) ||
+		    ((temp > settings.cold_limit - NEAR_LIMIT) && (temp < settings.cold_limit + NEAR_LIMIT)) ||
+		    ((temp > settings.hot_limit - NEAR_LIMIT) && (temp < settings.hot_limit + NEAR_LIMIT)))
+		{
+			steady_temp[i] = temp; // settle again from here
+			full = 1;
+		}
+		else
+		{
+			steady_temp[i] += STEADY_WEIGHT * (temp - steady_temp[i]);
+		}
+	}
+	if (full) return settings.period_ms;
+
+	period *= 2;
+	if (period > settings.max_period_ms) period = settings.max_period_ms;
+	return period;
+}
+
+int main(void)
+{
+	uint32_t sum[NUM_CHANNELS];
+	unsigned int adc[NUM_CHANNELS];
+	unsigned int last_sent[NUM_CHANNELS];
+	int num_samples = 0;
+	int first_adc;
+	int first_channel;
+	int period;
+	int send;
+	int state, last_state = -1; // 0: COLD, 1: IDLE, 2: HOT
+	uint32_t next_sample; // Millis() of the next sample
+	uint32_t sent_ms;     // Millis() of the last reading printed
+	uint32_t now;
 	float temp_Cdegrees;
-	unsigned char buff[CHARS_PER_LINE];
+	char buff[CHARS_PER_LINE];
+	int i;
 
 	init_Clock48();
-	UART3_init(115200);
+	UART3_init(link_baud);
+	UART3_RX_init();
 	InitSPI(200000);
+	RTC_Init();
 	LCD_4BIT();
 
+	Load_Settings();
+	Log_Init();
+	period = settings.period_ms;
+	Reset_Steady();
+
 	printf("\x1b[2J"); // Clear screen using ANSI escape sequence.
 
 	// set ports to be used as output
 	REG_PORT_DIRSET0 = PORT_PA24;
 	REG_PORT_DIRSET0 = PORT_PA25;
 
+	memset(sum, 0, sizeof(sum));
+	memset(last_sent, 0, sizeof(last_sent));
+	next_sample = Millis();
+	sent_ms = next_sample - HEARTBEAT_MS; // makes sure the first reading is printed
+
 	while(1)
 	{
-		// read ADC value and convert to temperature calue in celcius degrees
-		temp_Volts = (GetADC(0)*VREF) / 1023.0;
-		temp_Cdegrees = (100 * temp_Volts) - 273;
-
-		// print the temperature on serial comm
-		printf("%5.3f\n", temp_Cdegrees);
-		fflush(stdout);
-
-		// convert float to string and print it on LCD screen
-		sprintf(buff,"%f",temp_Cdegrees);
-		LCDprint(buff,2,1);
-
-		//depending on temperature value print the state of room and turn on leds 
-        //NOTE: THESE BOUNDARY VALUES ARE CHOSEN FOR DEMONSTRATION, NORMAL CONDITIONS CAN BE HIGHER OR LOWER FOR HOT AND COLD STATES
-        if(temp_Cdegrees<22.0){
-            LCDprint("Room State: COLD",1,1); 
-			REG_PORT_OUTCLR0 = PORT_PA24; // dangerous temperature: turn on red led
-			REG_PORT_OUTSET0 = PORT_PA25;
-        }
-        else if(temp_Cdegrees>30.0){
-            LCDprint("Room State: HOT",1,1);
- 			REG_PORT_OUTCLR0 = PORT_PA24; // dangerous temperature: turn on red led
-			REG_PORT_OUTSET0 = PORT_PA25;
-        }
-        else{
-            LCDprint("Room State: IDLE",1,1);
-			REG_PORT_OUTSET0 = PORT_PA24; // normal temperature: turn on green led
-			REG_PORT_OUTCLR0 = PORT_PA25;
-        }
-
-		delayMs(100);
+		// read the ADC value of every selected channel
+		for(i = 0; i < NUM_CHANNELS; i++)
+		{
+			if (settings.channels & (1<<i))
+			{
+				sum[i] += GetADC(i);
+				num_conversions++;
+			}
+		}
+		num_samples++;
+
+		if (num_samples >= settings.avg_window)
+		{
+			// average the window and check if any channel left the deadband
+			send = (Millis() - sent_ms >= HEARTBEAT_MS);
+			first_adc = -1;
+			first_channel = 0;
+			for(i = 0; i < NUM_CHANNELS; i++)
+			{
+				if ((settings.channels & (1<<i)) == 0) continue;
+
+				adc[i] = (sum[i] + num_samples/2) / num_samples;
+				if (first_adc < 0)
+				{
+					first_adc = adc[i];
+					first_channel = i;
+				}
+				if (Degrees_Apart(i, adc[i], last_sent[i]) >= settings.deadband) send = 1;
+			}
+			memset(sum, 0, sizeof(sum));
+			num_samples = 0;
+
+			Log_Sample(first_channel, first_adc);
+
+			// the LCD and the leds follow the first selected channel
+			temp_Cdegrees = ADC_to_Celsius(first_channel, first_adc);
+
+			//depending on temperature value print the state of room and turn on leds
+			if(temp_Cdegrees<settings.cold_limit){
+				state = 0;
+				LCDprint("Room State: COLD",1,1);
+				REG_PORT_OUTCLR0 = PORT_PA24; // dangerous temperature: turn on red led
+				REG_PORT_OUTSET0 = PORT_PA25;
+			}
+			else if(temp_Cdegrees>settings.hot_limit){
+				state = 2;
+				LCDprint("Room State: HOT",1,1);
+				REG_PORT_OUTCLR0 = PORT_PA24; // dangerous temperature: turn on red led
+				REG_PORT_OUTSET0 = PORT_PA25;
+			}
+			else{
+				state = 1;
+				LCDprint("Room State: IDLE",1,1);
+				REG_PORT_OUTSET0 = PORT_PA24; // normal temperature: turn on green led
+				REG_PORT_OUTCLR0 = PORT_PA25;
+			}
+			if (state != last_state) send = 1; // always report a change of room state
+			last_state = state;
+
+			// convert float to string and print it on LCD screen
+			sprintf(buff,"%f",temp_Cdegrees);
+			LCDprint(buff,2,1);
+
+			// print the averaged values on serial comm, one column per selected channel
+			if (send)
+			{
+				for(i = 0; i < NUM_CHANNELS; i++)
+				{
+					if ((settings.channels & (1<<i)) == 0) continue;
+
+					if (settings.out_mode == OUT_RAW) bytes_sent += printf("%u ", adc[i]);
+					else if (settings.out_mode == OUT_VOLTS) bytes_sent += printf("%5.3f ", ADC_to_Volts(adc[i]));
+					else bytes_sent += printf("%5.3f ", ADC_to_Celsius(i, adc[i]));
+					last_sent[i] = adc[i];
+				}
+				bytes_sent += printf("\n");
+				fflush(stdout);
+				sent_ms = Millis();
+			}
+
+			period = Next_Period(period, adc);
+		}
+
+		// the samples are period apart however long the LCD and the flash took, if they took longer
+		// the next one is taken right away without trying to catch up
+		next_sample += period;
+		now = Millis();
+		if ((int32_t)(now - next_sample) > 0) next_sample = now;
+		if (Wait_Until(next_sample))
+		{
+			// settings changed, start a new averaging window at the full rate
+			memset(sum, 0, sizeof(sum));
+			num_samples = 0;
+			period = settings.period_ms;
+			Reset_Steady();
+			next_sample = Millis();
+			sent_ms = next_sample - HEARTBEAT_MS;
+		}
 	}
 }
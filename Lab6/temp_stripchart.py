@@ -9,6 +9,7 @@
 #   Some parts of this code is taken from serial_in and stripchart_sinewave
 #   codes provided on the course page.
 
+import argparse
 import time
 import serial
 import serial.tools.list_ports
@@ -23,13 +24,18 @@ xsize = 100     # time axis size
 
 selected_color = 'purple' # can change the color of the graph
 
+parser = argparse.ArgumentParser(description='Stripchart of the temperature readings')
+parser.add_argument('--port', default='COM8', help='serial port of the board')
+parser.add_argument('--baud', type=int, default=115200, help='rate picked by temp_config.py --link')
+args = parser.parse_args()
+
 # configure the serial port
 try: 
     ser = serial.Serial(
-        port = 'COM8', # Change as needed
-        baudrate = 115200,
+        port = args.port,
+        baudrate = args.baud,
         parity = serial.PARITY_NONE,
-        stopbits = serial.STOPBITS_TWO,
+        stopbits = serial.STOPBITS_ONE,
         bytesize = serial.EIGHTBITS
     )
     ser.isOpen()
@@ -43,8 +49,13 @@ except:
 def temp_data_read():
     t = temp_data_read.t
     while True:
+        line = ser.readline().split()
+        # skip command replies (they start with '#') and lines garbled by a reset
+        try:
+            temp_value_float = float(line[0])  # temp_value_float has the temperature reading of the first channel
+        except (IndexError, ValueError):
+            continue
         t += 1
-        temp_value_float = float(ser.readline())  # temp_value_float has the temperature reading as a float number
         yield t, temp_value_float
 
 def run(data):
@@ -0,0 +1,115 @@
+# Authors:
+#   Kerem Oktay
+#   Idil Bil
+#
+# Functionality:
+#   Generates linearize.h, the per-channel tables the firmwares use to turn raw 10-bit ADC codes
+#   into engineering units without any float or log math on the microcontroller.
+#
+#   Each channel gets a sensor curve. The curve is evaluated here for the ADC code at every segment
+#   boundary and stored in hundredths of the unit, the firmware interpolates linearly between two
+#   entries with one subtraction, one 16-bit multiplication and one shift.
+#
+#   Sensors (voltage is the ADC input, x = code/1023 is the ratio for ratiometric sensors):
+#       lm335                     LM335 style, 10mV/K: T = 100*V - 273
+#       ntc:R0:B:RFIXED           NTC thermistor (R0 at 25C, beta B) at the bottom of a divider with
+#                                 RFIXED on top, both fed from VREF, limited to -55C to 150C
+#       poly:c0,c1,c2,...         c0 + c1*V + c2*V^2 + ...
+#       volts                     the voltage itself
+#
+#   Examples:
+#       python gen_linearize.py --vref 4.096 --target c51 -o ../Lab4/linearize.h
+#       python gen_linearize.py --vref 3.3 --target arm -o ../Lab6/linearize.h --channel 1=ntc:10000:3950:10000
+#
+# Note:
+#   The worst case error of the integer interpolation against the exact curve is printed for every
+#   channel and written in the header, use more segments (--bits 3) if it is too big.
+
+import argparse
+import math
+import sys
+
+adc_codes = 1024
+num_channels = 8
+scale = 100 # table entries are hundredths of the unit
+int_max = 32767
+
+def make_curve(spec, vref):
+    kind, _, params = spec.partition(':')
+    if kind == 'lm335':
+        return lambda code: 100.0 * code * vref / 1023.0 - 273.0
+    if kind == 'volts':
+        return lambda code: code * vref / 1023.0
+    if kind == 'poly':
+        coeffs = [float(c) for c in params.split(',')]
+        return lambda code: sum(c * (code * vref / 1023.0) ** i for i, c in enumerate(coeffs))
+    if kind == 'ntc':
+        r0, beta, rfixed = [float(p) for p in params.split(':')]
+        def ntc(code):
+            x = min(max(code, 0.5), 1022.5) / 1023.0 # the ends of the range are open/short circuits
+            r = rfixed * x / (1.0 - x)
+            t = 1.0 / (1.0 / 298.15 + math.log(r / r0) / beta) - 273.15
+            return min(max(t, -55.0), 150.0) # outside its rated range a thermistor reading means little
+        return ntc
+    raise ValueError('unknown sensor "%s"' % spec)
+
+def clamp(value):
+    return max(-int_max, min(int_max, int(round(value * scale))))
+
+def interpolate(table, code, bits):
+    # exactly what Linearize() in the firmware does
+    seg = code >> bits
+    frac = code & ((1 << bits) - 1)
+    y0, y1 = table[seg], table[seg + 1]
+    return y0 + (((y1 - y0) * frac) >> bits)
+
+def make_table(curve, bits):
+    segments = adc_codes >> bits
+    table = [clamp(curve(seg << bits)) for seg in range(segments + 1)]
+    for y0, y1 in zip(table, table[1:]):
+        if abs(y1 - y0) * ((1 << bits) - 1) > int_max:
+            raise ValueError('curve too steep for 16-bit interpolation, use fewer bits per segment')
+    error = max(abs(interpolate(table, code, bits) - clamp(curve(code))) for code in range(adc_codes))
+    return table, error / float(scale)
+
+parser = argparse.ArgumentParser(description='Generate the ADC linearization tables')
+parser.add_argument('--vref', type=float, required=True, help='ADC reference voltage of the board')
+parser.add_argument('--target', choices=['c51', 'arm'], required=True, help='c51 puts the tables in code memory')
+parser.add_argument('--bits', type=int, default=4, help='log2 of the ADC codes per segment')
+parser.add_argument('--channel', action='append', default=[], metavar='N=SENSOR',
+                    help='sensor of channel N, the channels not given are lm335')
+parser.add_argument('-o', '--output', required=True)
+args = parser.parse_args()
+
+sensors = ['lm335'] * num_channels
+for item in args.channel:
+    n, _, spec = item.partition('=')
+    sensors[int(n)] = spec
+
+tables = []
+for n, spec in enumerate(sensors):
+    try:
+        table, error = make_table(make_curve(spec, args.vref), args.bits)
+    except ValueError as e:
+        sys.exit('channel %d: %s' % (n, e))
+    print('channel %d: %-24s max error %.2f' % (n, spec, error))
+    tables.append((spec, table, error))
+
+storage = '__code ' if args.target == 'c51' else ''
+with open(args.output, 'w', newline='\r\n') as f:
+    f.write('// Generated by Tools/gen_linearize.py, do not edit\n')
+    f.write('// %s\n' % ' '.join(['gen_linearize.py', '--vref', str(args.vref), '--target', args.target,
+                                  '--bits', str(args.bits)] + ['--channel ' + c for c in args.channel]))
+    f.write('\n')
+    f.write('#define LIN_SEGMENT_BITS %d // ADC codes per segment: 2^LIN_SEGMENT_BITS\n' % args.bits)
+    f.write('#define LIN_SEGMENTS %d\n' % (adc_codes >> args.bits))
+    f.write('#define LIN_SCALE %d // table entries are hundredths of the unit\n' % scale)
+    f.write('#define LIN_CHANNELS %d\n' % num_channels)
+    f.write('\n')
+    f.write('%sconst int lin_table[LIN_CHANNELS][LIN_SEGMENTS+1] = {\n' % storage)
+    for n, (spec, table, error) in enumerate(tables):
+        f.write('    // channel %d: %s, max error %.2f\n' % (n, spec, error))
+        rows = [', '.join('%6d' % v for v in table[i:i + 11]) for i in range(0, len(table), 11)]
+        f.write('    {\n        %s\n    }%s\n' % (',\n        '.join(rows), ',' if n < num_channels - 1 else ''))
+    f.write('};\n')
+print('%s written' % args.output)
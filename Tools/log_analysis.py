@@ -0,0 +1,283 @@
+# Authors:
+#   Kerem Oktay
+#   Idil Bil
+#
+# Functionality:
+#   Analyses logged data from the labs on the PC instead of eyeballing the stripchart.
+#
+#   temp:  temperature logs (Lab 4 / Lab 6). Windowed min/max/mean/stddev, COLD/IDLE/HOT
+#          classification with the same limits as the firmware, state crossings and a histogram.
+#   lab5:  Lab 5 logs. Recomputes the RMS voltages from the logged peaks and the phase statistics.
+#          Two column REF/TEST sample logs are also accepted, then the RMS and the phase are
+#          computed from the samples of each window (--rate is needed).
+#   bench: writes synthetic .f32 temperature files to disk, analyses them through the same memory
+#          mapped path as 'temp' and reports the throughput in GB/s.
+#
+#   Examples:
+#       python log_analysis.py temp putty_log.txt --window 600
+#       python log_analysis.py temp board1.f32 board2.f32 --jobs 2
+#       python log_analysis.py temp four_channels.f32 --channels 4 --column 2
+#       python log_analysis.py lab5 phase_log.txt
+#       python log_analysis.py lab5 samples.f32 --rate 4000 --window 128
+#       python log_analysis.py bench --size-gb 4 --dir /data
+#
+# Note:
+#   Text logs are what putty (or the stripchart port) saves: one reading per line, lines starting
+#   with '#' are command replies and are skipped. Files ending in .f32 are raw little endian float32
+#   samples, --channels of them per reading when several channels were logged; they are memory
+#   mapped and processed in chunks so they can be larger than the RAM.
+#   Every kernel is a numpy array operation, so the inner loops run in numpy's SIMD code and
+#   release the GIL, which lets the threads in --jobs run in parallel.
+
+import argparse
+import concurrent.futures
+import os, sys, tempfile, time
+import numpy as np
+
+temp_low = -45   # same graph limits as the stripchart
+temp_high = 105
+cold_limit = 22.0 # same limits as the firmware
+hot_limit = 30.0
+state_names = ['COLD', 'IDLE', 'HOT']
+
+chunk_samples = 1 << 24 # 64MB of float32 per chunk
+max_crossings = 10000   # state changes kept for --verbose, the rest are only counted
+
+def load_columns(filename, columns):
+    # returns a (samples, columns) float32 array, memory mapped for .f32 files
+    if filename.endswith('.f32'):
+        data = np.memmap(filename, dtype='<f4', mode='r')
+        return data[:len(data) - len(data) % columns].reshape(-1, columns)
+    rows = []
+    with open(filename, errors='replace') as f:
+        for line in f:
+            fields = line.split()
+            if not fields or fields[0].startswith('#'):
+                continue
+            try:
+                rows.append([float(x) for x in fields[:columns]])
+            except ValueError:
+                continue # line garbled by a reset
+    rows = [r for r in rows if len(r) == columns]
+    return np.array(rows, dtype=np.float32).reshape(-1, columns)
+
+def classify(temp):
+    # 0: COLD, 1: IDLE, 2: HOT, same comparisons as the firmware
+    return (temp >= cold_limit).astype(np.int8) + (temp > hot_limit).astype(np.int8)
+
+class TempStats:
+    # accumulates the results chunk by chunk so huge files never have to fit in memory
+    def __init__(self, window, bins):
+        self.window = window
+        self.edges = np.linspace(temp_low, temp_high, bins + 1)
+        self.scale = np.float32(bins / (temp_high - temp_low))
+        self.hist = np.zeros(bins, dtype=np.int64)
+        self.windows = []
+        self.crossings = []
+        self.num_crossings = 0 # noise around a limit can change the state every few samples
+        self.state_counts = np.zeros(3, dtype=np.int64)
+        self.last_state = None
+        self.count = 0
+        self.leftover = np.zeros(0, dtype=np.float32)
+
+    def add_chunk(self, temp):
+        # windowed statistics on full windows, the rest waits for the next chunk
+        joined = np.concatenate((self.leftover, temp))
+        full = len(joined) - len(joined) % self.window
+        blocks = joined[:full].reshape(-1, self.window)
+        if len(blocks):
+            self.windows.append(np.stack((blocks.min(axis=1), blocks.max(axis=1),
+                                          blocks.mean(axis=1), blocks.std(axis=1)), axis=1))
+        self.leftover = joined[full:].copy()
+
+        # equal bins, so the bin is just the scaled temperature; everything outside the range is
+        # clamped into one extra bin at each end (NaN too, fmax/fmin drop it) and cut off after
+        bins = len(self.hist)
+        index = (temp - np.float32(temp_low)) * self.scale
+        np.fmax(index, -1, out=index)
+        np.fmin(index, bins, out=index)
+        index += 1
+        self.hist += np.bincount(index.astype(np.intp), minlength=bins + 2)[1:bins + 1]
+
+        state = classify(temp)
+        cold = np.count_nonzero(state == 0)
+        hot = np.count_nonzero(state == 2)
+        self.state_counts += [cold, len(temp) - cold - hot, hot]
+        if self.last_state is not None:
+            state = np.concatenate(([self.last_state], state))
+            offset = self.count - 1
+        else:
+            offset = self.count
+        changes = np.flatnonzero(np.diff(state)) + 1
+        self.num_crossings += len(changes)
+        room = max_crossings - sum(len(c) for c in self.crossings)
+        if room > 0 and len(changes):
+            changes = changes[:room]
+            self.crossings.append(np.stack((changes + offset, state[changes]), axis=1))
+        if len(state):
+            self.last_state = state[-1]
+        self.count += len(temp)
+
+    def result(self):
+        windows = np.concatenate(self.windows) if self.windows else np.zeros((0, 4))
+        crossings = np.concatenate(self.crossings) if self.crossings else np.zeros((0, 2), dtype=np.int64)
+        return windows, crossings
+
+def analyse_temp(filename, window, bins, column, channels):
+    # a text line has as many columns as channels, a .f32 file has them interleaved
+    data = load_columns(filename, channels if filename.endswith('.f32') else column + 1)[:, column]
+    stats = TempStats(window, bins)
+    for start in range(0, len(data), chunk_samples):
+        stats.add_chunk(np.asarray(data[start:start + chunk_samples], dtype=np.float32))
+    return filename, stats
+
+def print_temp(filename, stats, verbose):
+    windows, crossings = stats.result()
+    print('%s: %d samples' % (filename, stats.count))
+    if stats.count == 0:
+        return
+    for name, n in zip(state_names, stats.state_counts):
+        print('  %-4s %6.2f%%' % (name, 100.0 * n / stats.count))
+    print('  %d state changes' % stats.num_crossings)
+    if verbose:
+        for index, state in crossings:
+            print('    sample %d -> %s' % (index, state_names[state]))
+        if stats.num_crossings > len(crossings):
+            print('    ... %d more, only the first %d are kept' % (stats.num_crossings - len(crossings), max_crossings))
+    if len(windows):
+        print('  window of %d samples: min / max / mean / stddev' % stats.window)
+        for i, (lo, hi, mean, std) in enumerate(windows if verbose else windows[:10]):
+            print('    %6d  %7.3f %7.3f %7.3f %6.3f' % (i, lo, hi, mean, std))
+        if not verbose and len(windows) > 10:
+            print('    ... %d more windows (use --verbose)' % (len(windows) - 10))
+    print('  histogram:')
+    for lo, n in zip(stats.edges[:-1], stats.hist):
+        if n:
+            print('    %7.2f %d' % (lo, n))
+
+def wrap_phase(phase):
+    # same range as the firmware: -180 to 180 degrees
+    return (phase + 180.0) % 360.0 - 180.0
+
+def analyse_lab5_log(filename):
+    # lines printed by mag_phase_meas.c: freq = x  Vref_peak = x  Vtest_peak = x  Phase = x  Overruns = n
+    rows = []
+    with open(filename, errors='replace') as f:
+        for line in f:
+            fields = line.replace('=', ' ').split()
+            try:
+                values = dict(zip(fields[0::2], [float(x) for x in fields[1::2]]))
+                rows.append([values['freq'], values['Vref_peak'], values['Vtest_peak'], values['Phase']])
+            except (ValueError, KeyError):
+                continue
+    data = np.array(rows, dtype=np.float64).reshape(-1, 4)
+    freq, vr_peak, vt_peak, phase = data.T
+    return {'freq': freq, 'Vr_rms': vr_peak * 0.707107, 'Vt_rms': vt_peak * 0.707107, 'phase': wrap_phase(phase)}
+
+def analyse_lab5_samples(filename, rate, window):
+    # two columns: REF and TEST samples taken at the same instant, 'rate' pairs per second
+    data = load_columns(filename, 2)
+    full = len(data) - len(data) % window
+    blocks = np.asarray(data[:full], dtype=np.float64).reshape(-1, window, 2)
+    blocks = blocks - blocks.mean(axis=1, keepdims=True) # remove the DC offset
+    rms = np.sqrt((blocks ** 2).mean(axis=1))
+
+    # dominant frequency of the REF channel in each window, then one DFT bin for both channels
+    spectrum = np.fft.rfft(blocks, axis=1)
+    peak = np.abs(spectrum[:, 1:, 0]).argmax(axis=1) + 1
+    rows = np.arange(len(blocks))
+    ref = spectrum[rows, peak, 0]
+    test = spectrum[rows, peak, 1]
+    phase = wrap_phase(np.degrees(np.angle(test) - np.angle(ref)))
+    return {'freq': peak * rate / window, 'Vr_rms': rms[:, 0], 'Vt_rms': rms[:, 1], 'phase': phase}
+
+def print_lab5(filename, result):
+    print('%s: %d measurements' % (filename, len(result['freq'])))
+    for key in ['freq', 'Vr_rms', 'Vt_rms', 'phase']:
+        values = result[key]
+        if len(values):
+            print('  %-6s mean %9.3f  stddev %8.3f  min %9.3f  max %9.3f' %
+                  (key, values.mean(), values.std(), values.min(), values.max()))
+
+def write_synthetic(filename, size_gb, seed):
+    # synthetic room temperature: slow drift plus noise, crosses both limits
+    rng = np.random.default_rng(seed)
+    noise = rng.normal(0, 0.3, chunk_samples).astype(np.float32)
+    t = np.arange(chunk_samples, dtype=np.float64)
+    samples = int(size_gb * 1e9 / 4)
+    with open(filename, 'wb') as f:
+        for start in range(0, samples, chunk_samples):
+            chunk = (26.0 + 6.0 * np.sin((t + start) * 1e-5)).astype(np.float32) + noise
+            chunk[:samples - start].tofile(f)
+
+def bench(size_gb, window, bins, jobs, directory, keep):
+    # one file per thread, analysed exactly like 'temp' analyses the files it is given
+    files = [os.path.join(directory, 'log_analysis_bench%d.f32' % i) for i in range(jobs)]
+    start = time.perf_counter()
+    for i, filename in enumerate(files):
+        write_synthetic(filename, size_gb / jobs, 291 + i)
+    size = sum(os.path.getsize(f) for f in files)
+    elapsed = time.perf_counter() - start
+    print('wrote %.2f GB to %s in %.2f s' % (size / 1e9, directory, elapsed))
+
+    try:
+        start = time.perf_counter()
+        with concurrent.futures.ThreadPoolExecutor(jobs) as pool:
+            samples = sum(stats.count for _, stats in pool.map(lambda f: analyse_temp(f, window, bins, 0, 1), files))
+        elapsed = time.perf_counter() - start
+    finally:
+        if not keep:
+            for filename in files:
+                os.remove(filename)
+    size = samples * 4
+    print('%.2f GB in %.2f s with %d threads: %.2f GB/s' % (size / 1e9, elapsed, jobs, size / 1e9 / elapsed))
+    print('(just written, so the files may still be in the page cache; drop it first for the speed of the disk)')
+
+parser = argparse.ArgumentParser(description='Analyse logged lab data')
+sub = parser.add_subparsers(dest='command', required=True)
+
+p = sub.add_parser('temp', help='temperature logs')
+p.add_argument('files', nargs='+')
+p.add_argument('--window', type=int, default=100, help='samples per statistics window')
+p.add_argument('--bins', type=int, default=150, help='histogram bins between %d and %d' % (temp_low, temp_high))
+p.add_argument('--column', type=int, default=0, help='channel column when several channels were logged')
+p.add_argument('--channels', type=int, default=1, help='channels interleaved in the .f32 files')
+p.add_argument('--cold', type=float, default=cold_limit)
+p.add_argument('--hot', type=float, default=hot_limit)
+p.add_argument('--jobs', type=int, default=4, help='files analysed in parallel')
+p.add_argument('--verbose', action='store_true')
+
+p = sub.add_parser('lab5', help='Lab 5 magnitude and phase logs')
+p.add_argument('files', nargs='+')
+p.add_argument('--rate', type=float, help='sample pairs per second for two column sample logs')
+p.add_argument('--window', type=int, default=128, help='sample pairs per measurement')
+p.add_argument('--jobs', type=int, default=4)
+
+p = sub.add_parser('bench', help='throughput on synthetic files')
+p.add_argument('--size-gb', type=float, default=2.0, help='total size of the files written')
+p.add_argument('--dir', default=tempfile.gettempdir(), help='where the files are written')
+p.add_argument('--keep', action='store_true', help='keep the files, e.g. to run temp on them')
+p.add_argument('--window', type=int, default=100)
+p.add_argument('--bins', type=int, default=150)
+p.add_argument('--jobs', type=int, default=4)
+
+args = parser.parse_args()
+
+if args.command == 'temp':
+    cold_limit, hot_limit = args.cold, args.hot
+    if not 0 <= args.column < args.channels and any(f.endswith('.f32') for f in args.files):
+        sys.exit('--column has to be below --channels for .f32 files')
+    with concurrent.futures.ThreadPoolExecutor(args.jobs) as pool:
+        jobs = [pool.submit(analyse_temp, f, args.window, args.bins, args.column, args.channels) for f in args.files]
+        for job in jobs:
+            print_temp(*job.result(), args.verbose)
+elif args.command == 'lab5':
+    def analyse(filename):
+        if args.rate:
+            return filename, analyse_lab5_samples(filename, args.rate, args.window)
+        return filename, analyse_lab5_log(filename)
+    with concurrent.futures.ThreadPoolExecutor(args.jobs) as pool:
+        for filename, result in pool.map(analyse, args.files):
+            print_lab5(filename, result)
+else:
+    bench(args.size_gb, args.window, args.bins, args.jobs, args.dir, args.keep)